@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# Runs a headless dedicated server filled with bots and records its performance.
+#
+# Usage: RunLoadTest.sh [Bots] [Seconds] [Label]
+#
+# SERVER_BINARY  packaged BMGameplayServerServer binary, or
+# UE4_EDITOR     UE4Editor(-Cmd) binary to run the project with -server
+#
+# Frame and summary CSV files are written to Saved/Profiling/BMPerf. Each run appends a row to
+# BMPerfSummary.csv there, so runs of different builds can be compared.
+
+set -euo pipefail
+
+BOTS="${1:-32}"
+SECONDS_TO_RECORD="${2:-60}"
+LABEL="${3:-$(git -C "$(dirname "$0")" rev-parse --short HEAD 2>/dev/null || echo local)_${BOTS}bots}"
+
+PROJECT="$(cd "$(dirname "$0")/.." && pwd)/BMGameplayServer.uproject"
+MAP="/Game/FirstPersonCPP/Maps/FirstPersonExampleMap"
+ARGS=(-nullrhi -nosound -unattended -log "-bots=${BOTS}" -bmperf "-bmperfseconds=${SECONDS_TO_RECORD}" "-bmperflabel=${LABEL}")
+
+if [[ -n "${SERVER_BINARY:-}" ]]; then
+	exec "${SERVER_BINARY}" "${MAP}" "${ARGS[@]}"
+elif [[ -n "${UE4_EDITOR:-}" ]]; then
+	exec "${UE4_EDITOR}" "${PROJECT}" "${MAP}" -server "${ARGS[@]}"
+else
+	echo "Set SERVER_BINARY or UE4_EDITOR" >&2
+	exit 1
+fi
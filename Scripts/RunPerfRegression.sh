@@ -0,0 +1,21 @@
+#!/usr/bin/env bash
+# Runs the gameplay performance regression suite headless and fails when a scenario regressed
+# past its tolerance against the baselines in Config/DefaultGame.ini. Scenarios without a baseline
+# only warn, -strictbaseline fails on them.
+#
+# Usage: RunPerfRegression.sh [-scenario=Name] [-updatebaseline] [-strictbaseline]
+#
+# UE4_EDITOR  UE4Editor-Cmd binary
+#
+# Results are written to Saved/Profiling/BMPerf/BMPerfRegression.csv.
+
+set -euo pipefail
+
+if [[ -z "${UE4_EDITOR:-}" ]]; then
+	echo "Set UE4_EDITOR to the UE4Editor-Cmd binary" >&2
+	exit 1
+fi
+
+PROJECT="$(cd "$(dirname "$0")/.." && pwd)/BMGameplayServer.uproject"
+
+exec "${UE4_EDITOR}" "${PROJECT}" -run=BMPerfRegression -nullrhi -nosound -unattended -nosplash -stdout "$@"
@@ -0,0 +1,88 @@
+#!/usr/bin/env bash
+# Benchmarks replication on a headless dedicated server with real client connections. For every
+# client count a server is started with bots, that many -nullrhi clients connect to it, and the
+# server records for the given time and then exits.
+#
+# Usage: RunRepGraphBenchmark.sh [Seconds] [ClientCounts...]
+#
+# SERVER_BINARY  packaged BMGameplayServerServer binary, or
+# CLIENT_BINARY  packaged BMGameplayServer binary for the clients, or
+# UE4_EDITOR     UE4Editor(-Cmd) binary to run both with -server and -game
+# BOTS           AI bots moving on the server, 32 by default
+# REPGRAPH       0 runs the legacy replication path to compare against
+# PORT           server port, 7777 by default
+# WARMUP         seconds before the server starts recording, long enough for every client to join, 60 by default
+#
+# Each run appends a row every 10 seconds to BMRepGraph.csv and a summary row to BMPerfSummary.csv,
+# both in Saved/Profiling/BMPerf, labelled <commit>_<clients>clients.
+
+set -euo pipefail
+
+SECONDS_TO_RECORD="${1:-60}"
+shift || true
+CLIENT_COUNTS=("$@")
+if [[ ${#CLIENT_COUNTS[@]} -eq 0 ]]; then
+	CLIENT_COUNTS=(16 64 128)
+fi
+
+PROJECT="$(cd "$(dirname "$0")/.." && pwd)/BMGameplayServer.uproject"
+MAP="/Game/FirstPersonCPP/Maps/FirstPersonExampleMap"
+PORT="${PORT:-7777}"
+REVISION="$(git -C "$(dirname "$0")" rev-parse --short HEAD 2>/dev/null || echo local)"
+
+if [[ -n "${SERVER_BINARY:-}" ]]; then
+	SERVER=("${SERVER_BINARY}" "${MAP}")
+elif [[ -n "${UE4_EDITOR:-}" ]]; then
+	SERVER=("${UE4_EDITOR}" "${PROJECT}" "${MAP}" -server)
+else
+	echo "Set SERVER_BINARY or UE4_EDITOR" >&2
+	exit 1
+fi
+
+if [[ -n "${CLIENT_BINARY:-}" ]]; then
+	CLIENT=("${CLIENT_BINARY}" "127.0.0.1:${PORT}")
+elif [[ -n "${UE4_EDITOR:-}" ]]; then
+	CLIENT=("${UE4_EDITOR}" "${PROJECT}" "127.0.0.1:${PORT}" -game)
+else
+	echo "Set CLIENT_BINARY or UE4_EDITOR" >&2
+	exit 1
+fi
+
+CLIENT_PIDS=()
+stop_clients()
+{
+	if [[ ${#CLIENT_PIDS[@]} -gt 0 ]]; then
+		kill "${CLIENT_PIDS[@]}" 2>/dev/null || true
+		wait "${CLIENT_PIDS[@]}" 2>/dev/null || true
+	fi
+	CLIENT_PIDS=()
+}
+trap stop_clients EXIT
+
+for CLIENTS in "${CLIENT_COUNTS[@]}"; do
+	LABEL="${REVISION}_${CLIENTS}clients"
+	ARGS=(-nullrhi -nosound -unattended -log "-port=${PORT}" "-bots=${BOTS:-32}" -bmrepgraphreport=10
+		-bmperf "-bmperfseconds=${SECONDS_TO_RECORD}"
+		"-ini:Game:[/Script/BMGameplayServer.BMPerfRecorderSubsystem]:WarmupSeconds=${WARMUP:-60}")
+
+	if [[ "${REPGRAPH:-1}" == "0" ]]; then
+		LABEL="${LABEL}_legacy"
+		ARGS+=("-ini:Engine:[/Script/OnlineSubsystemUtils.IpNetDriver]:ReplicationDriverClassName=")
+	fi
+	ARGS+=("-bmperflabel=${LABEL}")
+
+	echo "Benchmarking ${LABEL}"
+	"${SERVER[@]}" "${ARGS[@]}" &
+	SERVER_PID=$!
+
+	# Clients that connect before the server listens retry on their own, but give it a head start
+	sleep 10
+	for ((i = 0; i < CLIENTS; ++i)); do
+		"${CLIENT[@]}" -nullrhi -nosound -unattended -nosplash >/dev/null 2>&1 &
+		CLIENT_PIDS+=($!)
+	done
+
+	# The server exits on its own once -bmperfseconds is up
+	wait "${SERVER_PID}" || true
+	stop_clients
+done
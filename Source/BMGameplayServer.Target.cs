@@ -10,5 +10,9 @@ public class BMGameplayServerTarget : TargetRules
 		Type = TargetType.Game;
 		DefaultBuildSettings = BuildSettingsVersion.V2;
 		ExtraModuleNames.Add("BMGameplayServer");
+#if UE_4_25_OR_LATER
+		// Gameplay properties replicate through the push model, see BM_WITH_PUSH_MODEL
+		bWithPushModel = true;
+#endif
 	}
 }
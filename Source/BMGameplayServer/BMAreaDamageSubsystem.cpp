@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMAreaDamageSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerCharacter.h"
+#include "BMDamageQueueSubsystem.h"
+#include "BMLagCompensationSubsystem.h"
+#include "BMPawnSpatialGrid.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Area damage issue"), STAT_BMAreaDamageIssue, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Area damage resolve"), STAT_BMAreaDamageResolve, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Area damage occlusion traces"), STAT_BMAreaDamageTraces, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Area damage targets occluded"), STAT_BMAreaDamageOccluded, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Area damage traces expired"), STAT_BMAreaDamageExpired, STATGROUP_BMGameplay);
+
+bool UBMAreaDamageSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+bool UBMAreaDamageSubsystem::IsTickable() const
+{
+	return PendingCasts.Num() > 0;
+}
+
+ETickableTickType UBMAreaDamageSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMAreaDamageSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMAreaDamageSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UBMAreaDamageSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UBMAreaDamageSubsystem::ApplySphereDamage(ABMGameplayServerCharacter* Caster, const FBMAreaDamageParams& Params)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMAreaDamageIssue);
+
+	UWorld* World = GetWorld();
+	TArray<ABMGameplayServerCharacter*> Candidates;
+	TArray<FVector> CandidateLocations;
+
+	// Hit enemies where the caster saw them
+	UBMLagCompensationSubsystem* LagCompensation = World->GetSubsystem<UBMLagCompensationSubsystem>();
+	UBMPawnSpatialGrid* SpatialGrid = World->GetSubsystem<UBMPawnSpatialGrid>();
+	if (LagCompensation && LagCompensation->IsEnabled())
+	{
+		const float ViewTime = LagCompensation->GetViewTime(Caster->GetController());
+		LagCompensation->GetCharactersInSphere(Params.Center, Params.Radius, ViewTime, Caster, Candidates);
+		for (const ABMGameplayServerCharacter* Candidate : Candidates)
+		{
+			FBMCapsuleSample Rewound;
+			float Radius;
+			CandidateLocations.Add(LagCompensation->GetCapsuleAtTime(Candidate, ViewTime, Rewound, Radius) ? Rewound.Location : Candidate->GetActorLocation());
+		}
+	}
+	else if (SpatialGrid)
+	{
+		SpatialGrid->GetCharactersInSphere(Params.Center, Params.Radius, Caster, Candidates);
+		for (const ABMGameplayServerCharacter* Candidate : Candidates)
+		{
+			CandidateLocations.Add(Candidate->GetActorLocation());
+		}
+	}
+
+	if (Candidates.Num() == 0)
+	{
+		return;
+	}
+
+	FBMAreaDamageCast& PendingCast = PendingCasts.AddDefaulted_GetRef();
+	PendingCast.InstigatedBy = Caster->GetController();
+	PendingCast.DamageCauser = Caster;
+	PendingCast.Center = Params.Center;
+	PendingCast.IssuedFrame = GFrameCounter;
+
+	for (int32 i = 0; i < Candidates.Num(); ++i)
+	{
+		const float Distance = FVector::Dist(Params.Center, CandidateLocations[i]);
+		const float Falloff = Params.FalloffExponent > 0.f
+			? FMath::Pow(FMath::Clamp(1.f - Distance / Params.Radius, 0.f, 1.f), Params.FalloffExponent)
+			: 1.f;
+
+		FBMAreaDamageTarget& Target = PendingCast.Targets.AddDefaulted_GetRef();
+		Target.Character = Candidates[i];
+		Target.Damage = Params.Damage * FMath::Max(Falloff, Params.MinDamageScale);
+		Target.TraceEnd = CandidateLocations[i];
+
+		if (Params.bRequireLineOfSight)
+		{
+			IssueOcclusionTrace(PendingCast, Target);
+		}
+	}
+}
+
+void UBMAreaDamageSubsystem::IssueOcclusionTrace(const FBMAreaDamageCast& PendingCast, FBMAreaDamageTarget& Target)
+{
+	// Only world geometry occludes, characters standing in between don't
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(BMAreaDamageOcclusion), false, PendingCast.DamageCauser.Get());
+	FCollisionResponseParams ResponseParams;
+	ResponseParams.CollisionResponse.SetResponse(ECC_Pawn, ECR_Ignore);
+
+	Target.OcclusionTrace = GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, PendingCast.Center, Target.TraceEnd,
+		ECC_Visibility, QueryParams, ResponseParams);
+	INC_DWORD_STAT(STAT_BMAreaDamageTraces);
+}
+
+void UBMAreaDamageSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMAreaDamageResolve);
+
+	for (int32 i = 0; i < PendingCasts.Num(); )
+	{
+		if (ResolveCast(PendingCasts[i]))
+		{
+			PendingCasts.RemoveAt(i, 1, false);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+bool UBMAreaDamageSubsystem::ResolveCast(FBMAreaDamageCast& PendingCast)
+{
+	// Async traces kicked off this frame are only readable the next one
+	if (GFrameCounter <= PendingCast.IssuedFrame)
+	{
+		return false;
+	}
+
+	UWorld* World = GetWorld();
+	bool bReissued = false;
+	for (int32 i = PendingCast.Targets.Num() - 1; i >= 0; --i)
+	{
+		FBMAreaDamageTarget& Target = PendingCast.Targets[i];
+		ABMGameplayServerCharacter* Character = Target.Character.Get();
+		if (Character == nullptr)
+		{
+			PendingCast.Targets.RemoveAtSwap(i, 1, false);
+			continue;
+		}
+
+		if (Target.OcclusionTrace.IsValid())
+		{
+			FTraceDatum Datum;
+			if (!World->QueryTraceData(Target.OcclusionTrace, Datum))
+			{
+				// Results only live for one frame, try once more and never damage through walls we couldn't check
+				INC_DWORD_STAT(STAT_BMAreaDamageExpired);
+				if (Target.TraceRetries++ == 0)
+				{
+					IssueOcclusionTrace(PendingCast, Target);
+					bReissued = true;
+				}
+				else
+				{
+					INC_DWORD_STAT(STAT_BMAreaDamageOccluded);
+					PendingCast.Targets.RemoveAtSwap(i, 1, false);
+				}
+				continue;
+			}
+
+			if (FHitResult::GetFirstBlockingHit(Datum.OutHits))
+			{
+				INC_DWORD_STAT(STAT_BMAreaDamageOccluded);
+				PendingCast.Targets.RemoveAtSwap(i, 1, false);
+				continue;
+			}
+		}
+
+		UBMDamageQueueSubsystem::QueueOrApplyDamage(Character, Target.Damage, PendingCast.InstigatedBy.Get(), PendingCast.DamageCauser.Get());
+		PendingCast.Targets.RemoveAtSwap(i, 1, false);
+	}
+
+	if (bReissued)
+	{
+		PendingCast.IssuedFrame = GFrameCounter;
+	}
+
+	return PendingCast.Targets.Num() == 0;
+}
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "WorldCollision.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMAreaDamageSubsystem.generated.h"
+
+class ABMGameplayServerCharacter;
+
+/** Shape and damage of one area of effect hit */
+struct FBMAreaDamageParams
+{
+	FVector Center = FVector::ZeroVector;
+	float Radius = 0.f;
+	float Damage = 0.f;
+
+	/** Damage scales with (1 - distance / radius) ^ FalloffExponent, 0 disables falloff */
+	float FalloffExponent = 0.f;
+
+	/** Falloff never scales damage below this */
+	float MinDamageScale = 0.f;
+
+	/** Walls between center and target block the damage */
+	bool bRequireLineOfSight = true;
+};
+
+/** Candidate waiting for its occlusion trace */
+struct FBMAreaDamageTarget
+{
+	TWeakObjectPtr<ABMGameplayServerCharacter> Character;
+	float Damage = 0.f;
+	FTraceHandle OcclusionTrace;
+
+	/** Where the occlusion trace ends, kept so an expired trace can be issued again */
+	FVector TraceEnd = FVector::ZeroVector;
+
+	/** Traces issued again after their results expired */
+	int32 TraceRetries = 0;
+};
+
+/** Area of effect hit waiting for its occlusion traces */
+struct FBMAreaDamageCast
+{
+	TWeakObjectPtr<AController> InstigatedBy;
+	TWeakObjectPtr<AActor> DamageCauser;
+	TArray<FBMAreaDamageTarget> Targets;
+
+	/** Where the occlusion traces start */
+	FVector Center = FVector::ZeroVector;
+
+	/** Traces issued on this frame are readable the next one */
+	uint64 IssuedFrame = 0;
+};
+
+/**
+ * Resolves area of effect damage without blocking the game thread on physics. Candidates come
+ * from lag compensation or the pawn spatial grid, one async line trace per candidate checks for
+ * walls, and damage is queued when the traces come back next frame. Server only.
+ */
+UCLASS()
+class BMGAMEPLAYSERVER_API UBMAreaDamageSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Damages every character in the sphere except the caster, where the caster saw them */
+	void ApplySphereDamage(ABMGameplayServerCharacter* Caster, const FBMAreaDamageParams& Params);
+
+private:
+	/**
+	 * Applies damage to targets whose traces are back and drops them from the cast. Expired traces
+	 * are issued again once, after that the target counts as occluded. Returns true when no targets are left.
+	 */
+	bool ResolveCast(FBMAreaDamageCast& PendingCast);
+
+	/** Starts the async line of sight trace from the cast's center to the target */
+	void IssueOcclusionTrace(const FBMAreaDamageCast& PendingCast, FBMAreaDamageTarget& Target);
+
+	TArray<FBMAreaDamageCast> PendingCasts;
+};
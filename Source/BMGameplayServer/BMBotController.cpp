@@ -0,0 +1,126 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMBotController.h"
+
+#include "BMGameplayServerCharacter.h"
+#include "BMPawnSpatialGrid.h"
+#include "BMSphereAttackComponent.h"
+#include "NavigationSystem.h"
+#include "Navigation/PathFollowingComponent.h"
+#include "Engine/World.h"
+#include "TimerManager.h"
+
+ABMBotController::ABMBotController()
+{
+	ThinkInterval = 0.25f;
+	WanderRadius = 3000.0f;
+	EngageRadius = 2500.0f;
+	FireInterval = 0.5f;
+	SphereChance = 0.05f;
+	SphereChargeTime = 1.5f;
+	LastFireTime = 0.0f;
+	SphereReleaseTime = 0.0f;
+}
+
+void ABMBotController::OnPossess(APawn* InPawn)
+{
+	Super::OnPossess(InPawn);
+
+	// Spread bots over the think interval so they don't all decide on the same frame
+	GetWorldTimerManager().SetTimer(ThinkTimerHandle, this, &ABMBotController::Think, ThinkInterval, true, FMath::FRandRange(0.0f, ThinkInterval));
+}
+
+void ABMBotController::OnUnPossess()
+{
+	GetWorldTimerManager().ClearTimer(ThinkTimerHandle);
+	SphereReleaseTime = 0.0f;
+
+	Super::OnUnPossess();
+}
+
+void ABMBotController::Think()
+{
+	ABMGameplayServerCharacter* Bot = Cast<ABMGameplayServerCharacter>(GetPawn());
+	if (Bot == nullptr)
+	{
+		return;
+	}
+
+	if (Bot->IsDead())
+	{
+		// Respawn resets the sphere, a dead bot just waits
+		StopMovement();
+		ClearFocus(EAIFocusPriority::Gameplay);
+		SphereReleaseTime = 0.0f;
+		return;
+	}
+
+	// Wander between random reachable points
+	if (GetMoveStatus() == EPathFollowingStatus::Idle)
+	{
+		UNavigationSystemV1* NavSys = UNavigationSystemV1::GetCurrent<UNavigationSystemV1>(GetWorld());
+		FNavLocation Destination;
+		if (NavSys && NavSys->GetRandomReachablePointInRadius(Bot->GetActorLocation(), WanderRadius, Destination))
+		{
+			MoveToLocation(Destination.Location);
+		}
+	}
+
+	// Focus drives the control rotation, which is where OnFire aims
+	const float Now = GetWorld()->GetTimeSeconds();
+	ABMGameplayServerCharacter* Target = FindTarget(Bot);
+	if (Target)
+	{
+		SetFocus(Target);
+		if (Now - LastFireTime >= FireInterval)
+		{
+			LastFireTime = Now;
+			Bot->OnFire();
+		}
+	}
+	else
+	{
+		ClearFocus(EAIFocusPriority::Gameplay);
+	}
+
+	// Charge and release the sphere like a player holding the button
+	if (SphereReleaseTime > 0.0f)
+	{
+		if (Now >= SphereReleaseTime)
+		{
+			SphereReleaseTime = 0.0f;
+			Bot->OnDeactivateSpell();
+		}
+	}
+	else if (!Bot->SphereAttackComp->IsInCooldown() && FMath::FRand() < SphereChance)
+	{
+		SphereReleaseTime = Now + SphereChargeTime;
+		Bot->OnActivateSpell();
+	}
+}
+
+ABMGameplayServerCharacter* ABMBotController::FindTarget(const ABMGameplayServerCharacter* Bot) const
+{
+	UBMPawnSpatialGrid* SpatialGrid = GetWorld()->GetSubsystem<UBMPawnSpatialGrid>();
+	if (SpatialGrid == nullptr)
+	{
+		return nullptr;
+	}
+
+	TArray<ABMGameplayServerCharacter*> Candidates;
+	SpatialGrid->GetCharactersInSphere(Bot->GetActorLocation(), EngageRadius, Bot, Candidates);
+
+	ABMGameplayServerCharacter* Closest = nullptr;
+	float ClosestDistSq = MAX_flt;
+	for (ABMGameplayServerCharacter* Candidate : Candidates)
+	{
+		const float DistSq = FVector::DistSquared(Candidate->GetActorLocation(), Bot->GetActorLocation());
+		if (!Candidate->IsDead() && DistSq < ClosestDistSq)
+		{
+			Closest = Candidate;
+			ClosestDistSq = DistSq;
+		}
+	}
+	return Closest;
+}
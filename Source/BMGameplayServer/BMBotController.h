@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AIController.h"
+#include "BMBotController.generated.h"
+
+class ABMGameplayServerCharacter;
+
+/**
+ * Load test bot. Wanders the navmesh, shoots the closest character in range and charges and
+ * releases the sphere spell through the same handlers player input uses, so a server full of
+ * bots exercises the real fire, damage and replication paths. Thinks on a timer, not every frame.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API ABMBotController : public AAIController
+{
+	GENERATED_BODY()
+
+public:
+	ABMBotController();
+
+protected:
+	virtual void OnPossess(APawn* InPawn) override;
+	virtual void OnUnPossess() override;
+
+	/** Seconds between decisions */
+	UPROPERTY(config)
+	float ThinkInterval;
+
+	/** Wander targets are picked within this distance, in cm */
+	UPROPERTY(config)
+	float WanderRadius;
+
+	/** Characters closer than this are shot at, in cm */
+	UPROPERTY(config)
+	float EngageRadius;
+
+	/** Seconds between shots while a target is in range */
+	UPROPERTY(config)
+	float FireInterval;
+
+	/** Chance per decision to start charging the sphere when it is off cooldown */
+	UPROPERTY(config)
+	float SphereChance;
+
+	/** Seconds the sphere is charged before release */
+	UPROPERTY(config)
+	float SphereChargeTime;
+
+private:
+	void Think();
+
+	/** Closest living character within EngageRadius */
+	ABMGameplayServerCharacter* FindTarget(const ABMGameplayServerCharacter* Bot) const;
+
+	FTimerHandle ThinkTimerHandle;
+
+	float LastFireTime;
+
+	/** World time the charging sphere is released, 0 when not charging */
+	float SphereReleaseTime;
+};
@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "BMCosmeticSkeletalMeshComponent.generated.h"
+
+/**
+ * Skeletal mesh only clients ever see, like first person arms and gun meshes. Server builds skip
+ * its serialized template, so the mesh, materials and anim blueprint it references are never
+ * loaded or cooked for a dedicated server. The component itself is still created by the owner's
+ * constructor, without a mesh.
+ */
+UCLASS(ClassGroup=Rendering, meta=(BlueprintSpawnableComponent))
+class BMGAMEPLAYSERVER_API UBMCosmeticSkeletalMeshComponent : public USkeletalMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool NeedsLoadForServer() const override;
+};
@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMDamageQueueSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+
+DECLARE_CYCLE_STAT(TEXT("Damage queue flush"), STAT_BMDamageQueueFlush, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Damage events queued"), STAT_BMDamageQueued, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Damage events coalesced"), STAT_BMDamageCoalesced, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Damage events applied"), STAT_BMDamageApplied, STATGROUP_BMGameplay);
+
+UBMDamageQueueSubsystem::UBMDamageQueueSubsystem()
+{
+	bEnabled = true;
+}
+
+bool UBMDamageQueueSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+void UBMDamageQueueSubsystem::Deinitialize()
+{
+	Pending.Reset();
+	PendingIndices.Reset();
+
+	Super::Deinitialize();
+}
+
+bool UBMDamageQueueSubsystem::IsTickable() const
+{
+	return Pending.Num() > 0;
+}
+
+ETickableTickType UBMDamageQueueSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMDamageQueueSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMDamageQueueSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UBMDamageQueueSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UBMDamageQueueSubsystem::Tick(float DeltaTime)
+{
+	// Ticks after all actors, so this is the end of the gameplay frame
+	Flush();
+}
+
+void UBMDamageQueueSubsystem::QueueDamage(AActor* Target, float Damage, AController* InstigatedBy, AActor* DamageCauser)
+{
+	if (Target == nullptr)
+	{
+		return;
+	}
+
+	INC_DWORD_STAT(STAT_BMDamageQueued);
+
+	const int32* Index = PendingIndices.Find(Target);
+	if (Index)
+	{
+		INC_DWORD_STAT(STAT_BMDamageCoalesced);
+
+		FBMQueuedDamage& Queued = Pending[*Index];
+		Queued.Damage += Damage;
+		Queued.InstigatedBy = InstigatedBy;
+		Queued.DamageCauser = DamageCauser;
+		return;
+	}
+
+	FBMQueuedDamage& Queued = Pending.AddDefaulted_GetRef();
+	Queued.Target = Target;
+	Queued.Damage = Damage;
+	Queued.InstigatedBy = InstigatedBy;
+	Queued.DamageCauser = DamageCauser;
+	PendingIndices.Add(Target, Pending.Num() - 1);
+}
+
+void UBMDamageQueueSubsystem::QueueOrApplyDamage(AActor* Target, float Damage, AController* InstigatedBy, AActor* DamageCauser)
+{
+	if (Target == nullptr)
+	{
+		return;
+	}
+
+	UWorld* World = Target->GetWorld();
+	UBMDamageQueueSubsystem* DamageQueue = World ? World->GetSubsystem<UBMDamageQueueSubsystem>() : nullptr;
+	if (DamageQueue && DamageQueue->IsEnabled())
+	{
+		DamageQueue->QueueDamage(Target, Damage, InstigatedBy, DamageCauser);
+		return;
+	}
+
+	FDamageEvent DamageEvent;
+	Target->TakeDamage(Damage, DamageEvent, InstigatedBy, DamageCauser);
+}
+
+void UBMDamageQueueSubsystem::Flush()
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMDamageQueueFlush);
+
+	Flushing.Reset();
+	Swap(Flushing, Pending);
+	PendingIndices.Reset();
+
+	// First hit first, the same order every run
+	for (const FBMQueuedDamage& Queued : Flushing)
+	{
+		AActor* Target = Queued.Target.Get();
+		if (Target && !Target->IsPendingKillPending())
+		{
+			INC_DWORD_STAT(STAT_BMDamageApplied);
+
+			FDamageEvent DamageEvent;
+			Target->TakeDamage(Queued.Damage, DamageEvent, Queued.InstigatedBy.Get(), Queued.DamageCauser.Get());
+		}
+	}
+
+	Flushing.Reset();
+}
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMDamageQueueSubsystem.generated.h"
+
+/** Damage accumulated for one target during the frame */
+struct FBMQueuedDamage
+{
+	TWeakObjectPtr<AActor> Target;
+	float Damage = 0.f;
+
+	/** Last instigator and causer queued, so the killing blow is credited */
+	TWeakObjectPtr<AController> InstigatedBy;
+	TWeakObjectPtr<AActor> DamageCauser;
+};
+
+/**
+ * Server damage pipeline. Gameplay code queues damage during the frame instead of calling
+ * AActor::TakeDamage, the queue sums it per target and applies it once per target after all
+ * actors ticked, in the order targets were first hit. Each character then sees at most one
+ * health change per frame.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMDamageQueueSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UBMDamageQueueSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Queues damage for the end of the frame. Server only */
+	void QueueDamage(AActor* Target, float Damage, AController* InstigatedBy, AActor* DamageCauser);
+
+	/** Queues damage on the target's world queue, or applies it right away when queuing is disabled */
+	static void QueueOrApplyDamage(AActor* Target, float Damage, AController* InstigatedBy, AActor* DamageCauser);
+
+	/** Applies everything queued so far */
+	void Flush();
+
+	/** Damage is queued rather than applied immediately */
+	FORCEINLINE bool IsEnabled() const { return bEnabled; }
+
+protected:
+	/** Queue damage and apply it once per target at the end of the frame */
+	UPROPERTY(config)
+	bool bEnabled;
+
+private:
+	TArray<FBMQueuedDamage> Pending;
+	TMap<const AActor*, int32> PendingIndices;
+
+	/** Swapped with Pending while flushing, damage caused by damage lands next frame */
+	TArray<FBMQueuedDamage> Flushing;
+};
@@ -8,6 +8,9 @@ public class BMGameplayServer : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "NavigationSystem" });
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "NavigationSystem", "ReplicationGraph", "AIModule" });
+#if UE_4_25_OR_LATER
+		PublicDependencyModuleNames.Add("NetCore");
+#endif
 	}
 }
@@ -2,6 +2,57 @@
 
 #include "BMGameplayServer.h"
 #include "Modules/ModuleManager.h"
+#include "Misc/CoreDelegates.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, BMGameplayServer, "BMGameplayServer" );
- 
\ No newline at end of file
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Live projectiles"), STAT_BMLiveProjectiles, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Active spheres"), STAT_BMActiveSpheres, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Dead pawns"), STAT_BMDeadPawns, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Awake health components"), STAT_BMAwakeHealthComponents, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Dormant health components"), STAT_BMDormantHealthComponents, STATGROUP_BMGameplay);
+
+CSV_DEFINE_CATEGORY_MODULE(BMGAMEPLAYSERVER_API, BMGameplay, true);
+
+namespace BMEntityCounts
+{
+	int32 LiveProjectiles = 0;
+	int32 ActiveSpheres = 0;
+	int32 DeadPawns = 0;
+	int32 AwakeHealthComponents = 0;
+	int32 DormantHealthComponents = 0;
+
+	static void Publish()
+	{
+		SET_DWORD_STAT(STAT_BMLiveProjectiles, LiveProjectiles);
+		SET_DWORD_STAT(STAT_BMActiveSpheres, ActiveSpheres);
+		SET_DWORD_STAT(STAT_BMDeadPawns, DeadPawns);
+		SET_DWORD_STAT(STAT_BMAwakeHealthComponents, AwakeHealthComponents);
+		SET_DWORD_STAT(STAT_BMDormantHealthComponents, DormantHealthComponents);
+
+		CSV_CUSTOM_STAT(BMGameplay, LiveProjectiles, LiveProjectiles, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(BMGameplay, ActiveSpheres, ActiveSpheres, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(BMGameplay, DeadPawns, DeadPawns, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(BMGameplay, AwakeHealthComponents, AwakeHealthComponents, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(BMGameplay, DormantHealthComponents, DormantHealthComponents, ECsvCustomStatOp::Set);
+	}
+}
+
+class FBMGameplayServerModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		EndFrameHandle = FCoreDelegates::OnEndFrame.AddStatic(&BMEntityCounts::Publish);
+	}
+
+	virtual void ShutdownModule() override
+	{
+		FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	}
+
+private:
+	FDelegateHandle EndFrameHandle;
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FBMGameplayServerModule, BMGameplayServer, "BMGameplayServer" );
+
+DEFINE_LOG_CATEGORY(LogBMGameplay);
@@ -3,3 +3,70 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+/**
+ * Push model replication arrived in 4.25, older engines compare every property on every net update.
+ * The macros below are no-ops on the project's 4.24; after upgrading, also set net.IsPushModelEnabled=1.
+ */
+#define BM_WITH_PUSH_MODEL (ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25)
+
+#if BM_WITH_PUSH_MODEL
+#include "Net/Core/PushModel/PushModel.h"
+#endif
+
+DECLARE_LOG_CATEGORY_EXTERN(LogBMGameplay, Log, All);
+
+/** Stat group for gameplay systems of this module ("stat BMGameplay") */
+DECLARE_STATS_GROUP(TEXT("BMGameplay"), STATGROUP_BMGameplay, STATCAT_Advanced);
+
+/** CSV profiler category for gameplay hot paths and entity counts ("csvprofile start") */
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(BMGAMEPLAYSERVER_API, BMGameplay);
+
+#if BM_WITH_PUSH_MODEL
+/** Replicates a property through the push model, it is only compared after BM_MARK_PROPERTY_DIRTY */
+#define BM_DOREPLIFETIME_PUSH(ClassName, PropertyName, InCondition) \
+	{ \
+		FDoRepLifetimeParams PushParams; \
+		PushParams.bIsPushBased = true; \
+		PushParams.Condition = InCondition; \
+		DOREPLIFETIME_WITH_PARAMS_FAST(ClassName, PropertyName, PushParams); \
+	}
+
+/** Marks a push model property for the next net update, call it wherever the server changes the property */
+#define BM_MARK_PROPERTY_DIRTY(ClassName, PropertyName, Object) MARK_PROPERTY_DIRTY_FROM_NAME(ClassName, PropertyName, Object)
+#else
+#define BM_DOREPLIFETIME_PUSH(ClassName, PropertyName, InCondition) DOREPLIFETIME_CONDITION(ClassName, PropertyName, InCondition)
+#define BM_MARK_PROPERTY_DIRTY(ClassName, PropertyName, Object)
+#endif
+
+/** Live gameplay entities of this process, published to stats and CSV captures at the end of every frame */
+namespace BMEntityCounts
+{
+	/** Projectile actors in flight, pooled ones parked in the pool are not counted */
+	extern BMGAMEPLAYSERVER_API int32 LiveProjectiles;
+
+	/** Sphere spells being charged */
+	extern BMGAMEPLAYSERVER_API int32 ActiveSpheres;
+
+	/** Characters waiting to respawn */
+	extern BMGAMEPLAYSERVER_API int32 DeadPawns;
+
+	/** Health components the server still compares for replication */
+	extern BMGAMEPLAYSERVER_API int32 AwakeHealthComponents;
+
+	/** Health components left out of replication until their health changes */
+	extern BMGAMEPLAYSERVER_API int32 DormantHealthComponents;
+
+	/** Moves an entity in or out of Count when its state changed since it was last counted */
+	FORCEINLINE void Track(int32& Count, bool& bCounted, bool bState)
+	{
+		if (bCounted != bState)
+		{
+			Count += bState ? 1 : -1;
+			bCounted = bState;
+		}
+	}
+}
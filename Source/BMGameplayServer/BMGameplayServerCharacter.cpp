@@ -12,16 +12,95 @@
 #include "MotionControllerComponent.h"
 #include "XRMotionControllerBase.h" // for FXRMotionControllerBase::RightHandSourceId
 #include "BMHealthComponent.h"
+#include "BMCosmeticSkeletalMeshComponent.h"
 #include "Engine/Engine.h"
 #include "BMGameplayServerGameMode.h"
 #include "TimerManager.h"
 #include "Net/UnrealNetwork.h"
-#include "NavigationSystem.h"
 #include "BMSphereAttackComponent.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "BMProjectilePoolSubsystem.h"
+#include "BMProjectileBatchSubsystem.h"
+#include "BMLagCompensationSubsystem.h"
+#include "BMPawnSpatialGrid.h"
+#include "BMNetReportSubsystem.h"
+#include "Engine/ActorChannel.h"
+#include "BMGameplayServer.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Server meshes skipping pose"), STAT_BMServerMeshesSkippingPose, STATGROUP_BMGameplay);
+
+DECLARE_CYCLE_STAT(TEXT("Health change"), STAT_BMHealthChange, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Character respawn"), STAT_BMCharacterRespawn, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Reset for respawn"), STAT_BMResetForRespawn, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Respawns"), STAT_BMRespawns, STATGROUP_BMGameplay);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Predicted shots"), STAT_BMPredictedShots, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Predicted shots confirmed"), STAT_BMPredictedShotsConfirmed, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Predicted shots unconfirmed"), STAT_BMPredictedShotsUnconfirmed, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Predicted shots diverged"), STAT_BMPredictedShotsDiverged, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Fire origins corrected"), STAT_BMFireOriginsCorrected, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shots received"), STAT_BMShotsReceived, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shots deduplicated"), STAT_BMShotsDeduplicated, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shots recovered by resend"), STAT_BMShotsRecovered, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shots lost"), STAT_BMShotsLost, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shots over the fire rate"), STAT_BMShotsRejected, STATGROUP_BMGameplay);
+
+namespace BMFirePrediction
+{
+	/** Predicted shots not answered after this long are dropped, in seconds */
+	static const float ConfirmTimeout = 1.0f;
+
+	/** Launches further apart than this, in cm or in cosine of the angle, count as diverged */
+	static const float DivergedDistance = 10.0f;
+	static const float DivergedDirectionDot = 0.999f;
+
+	static uint64 NumPredicted = 0;
+	static uint64 NumConfirmed = 0;
+	static uint64 NumUnconfirmed = 0;
+	static uint64 NumDiverged = 0;
+	static uint64 NumServerShots = 0;
+	static uint64 NumOriginsCorrected = 0;
+	static uint64 NumShotsDeduplicated = 0;
+	static uint64 NumShotsRecovered = 0;
+	static uint64 NumShotsLost = 0;
+	static uint64 NumShotsRejected = 0;
+
+	/** Sequence A is newer than B, across wrap around */
+	static FORCEINLINE bool IsNewerShot(uint16 A, uint16 B)
+	{
+		return int16(A - B) > 0;
+	}
+	static double TotalOriginError = 0.0;
+}
+
+namespace BMServerAnimation
+{
+	/** Mesh frames not evaluated by characters that already ended play, and what evaluating them would have cost */
+	static uint64 EndedSkippedFrames = 0;
+	static double EndedSkippedSeconds = 0.0;
+
+	/** Timed pose evaluations of one character class, what a skipped frame would have cost */
+	struct FReferencePose
+	{
+		double Seconds = 0.0;
+		int32 Samples = 0;
+	};
+	static TMap<const UClass*, FReferencePose> ReferencePoses;
+
+	/** Characters of a class that contribute a timed evaluation when they start skipping */
+	static const int32 MaxReferenceSamples = 16;
+
+	static double GetReferencePoseSeconds(const UClass* Class)
+	{
+		const FReferencePose* Reference = ReferencePoses.Find(Class);
+		return Reference && Reference->Samples > 0 ? Reference->Seconds / Reference->Samples : 0.0;
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 // ABMGameplayServerCharacter
 
@@ -41,7 +120,7 @@ ABMGameplayServerCharacter::ABMGameplayServerCharacter()
 	FirstPersonCameraComponent->bUsePawnControlRotation = true;
 
 	// Create a mesh component that will be used when being viewed from a '1st person' view (when controlling this pawn)
-	FP_Mesh = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("FP_Mesh"));
+	FP_Mesh = CreateDefaultSubobject<UBMCosmeticSkeletalMeshComponent>(TEXT("FP_Mesh"));
 	FP_Mesh->SetOnlyOwnerSee(true);
 	FP_Mesh->SetupAttachment(FirstPersonCameraComponent);
 	FP_Mesh->bCastDynamicShadow = false;
@@ -56,7 +135,7 @@ ABMGameplayServerCharacter::ABMGameplayServerCharacter()
 	FP_Mesh->SetRelativeLocation(FVector(-0.5f, -4.4f, -155.7f));
 
 	// Create a gun mesh component
-	FP_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("FP_Gun"));
+	FP_Gun = CreateDefaultSubobject<UBMCosmeticSkeletalMeshComponent>(TEXT("FP_Gun"));
 	FP_Gun->SetOnlyOwnerSee(true);			// only the owning player will see this mesh
 	FP_Gun->bCastDynamicShadow = false;
 	FP_Gun->CastShadow = false;
@@ -70,11 +149,14 @@ ABMGameplayServerCharacter::ABMGameplayServerCharacter()
 	// Default offset from the character location for projectiles to spawn
 	GunOffset = FVector(100.0f, 0.0f, 10.0f);
 
+	// Where the unanimated first person gun holds the muzzle, relative to the capsule
+	ServerMuzzleOffset = FVector(20.0f, 22.0f, 50.0f);
+
 	// Note: The ProjectileClass and the skeletal mesh/anim blueprints for FP_Mesh, FP_Gun, and VR_Gun 
 	// are set in the derived blueprint asset named MyCharacter to avoid direct content references in C++.
 
 	// Create 3rd person gun mesh component
-	TP_Gun = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("TP_Gun"));
+	TP_Gun = CreateDefaultSubobject<UBMCosmeticSkeletalMeshComponent>(TEXT("TP_Gun"));
 	TP_Gun->SetOwnerNoSee(true);			// only other players will see this mesh
 	TP_Gun->SetupAttachment(GetMesh(), TEXT("hand_rSocket"));
 
@@ -96,24 +178,119 @@ ABMGameplayServerCharacter::ABMGameplayServerCharacter()
 
 	bDeath = false;
 	RespawnTime = 5.0f;
+
+	bNativeFire = true;
+	bPredictProjectiles = true;
+	MaxFireOriginError = 100.0f;
+	LastShotId = 0;
+	LastAckedShot = 0;
+	RedundantShotCount = 3;
+	MinRefireInterval = 0.1f;
+	LastFireTime = -MAX_flt;
+	ShotBudget = 1.0f;
+	ShotBudgetTime = 0.0f;
+
+	ServerAnimationPolicy = EBMServerAnimationPolicy::OnDemand;
+	bSkippingServerPose = false;
+	bCountedDead = false;
+	ServerPoseSkipStartFrame = 0;
+}
+
+void ABMGameplayServerCharacter::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	if (IsNetMode(NM_DedicatedServer))
+	{
+		StripCosmeticComponents();
+	}
+}
+
+void ABMGameplayServerCharacter::StripCosmeticComponents()
+{
+	// The muzzle stays because projectiles spawn from it, move it off the gun before the gun goes
+	if (FP_MuzzleLocation)
+	{
+		FP_MuzzleLocation->AttachToComponent(GetCapsuleComponent(), FAttachmentTransformRules::KeepRelativeTransform);
+		FP_MuzzleLocation->SetRelativeLocation(ServerMuzzleOffset);
+	}
+
+	// Children first so nothing gets reattached to a component that is about to go
+	USceneComponent* cosmeticComponents[] = { FP_Gun, FP_Mesh, FirstPersonCameraComponent, TP_Gun };
+	for (USceneComponent* component : cosmeticComponents)
+	{
+		if (component)
+		{
+			component->DestroyComponent();
+		}
+	}
+
+	FP_Gun = nullptr;
+	FP_Mesh = nullptr;
+	FirstPersonCameraComponent = nullptr;
+	TP_Gun = nullptr;
+
+	// Nothing plays fire effects on a dedicated server, let the assets go. They stay hard references
+	// because the Blueprint's OnFireBP reads them, so server builds still load these few
+	FP_FireAnimation = nullptr;
+	TP_FireAnimation = nullptr;
+	FireSound = nullptr;
 }
 
 void ABMGameplayServerCharacter::Respawn()
 {
+	SCOPE_CYCLE_COUNTER(STAT_BMCharacterRespawn);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, CharacterRespawn);
+
 	if (GetLocalRole() == ROLE_Authority)
 	{
-		// Respawn at random navmesh location
-		UNavigationSystemV1* navSys = UNavigationSystemV1::GetCurrent(GetWorld());
-		FNavLocation navLocation;
-		navSys->GetRandomPoint(navLocation);
-		
-		SetActorLocation(navLocation);
+		ABMGameplayServerGameMode* gameMode = GetWorld()->GetAuthGameMode<ABMGameplayServerGameMode>();
+		if (gameMode)
+		{
+			gameMode->Respawn(this);
+		}
+		else
+		{
+			ResetForRespawn(GetActorLocation());
+		}
+	}
+}
+
+void ABMGameplayServerCharacter::ResetForRespawn(const FVector& SpawnLocation)
+{
+	if (GetLocalRole() != ROLE_Authority)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_BMResetForRespawn);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, ResetForRespawn);
+	CSV_CUSTOM_STAT(BMGameplay, Respawns, 1, ECsvCustomStatOp::Accumulate);
+	INC_DWORD_STAT(STAT_BMRespawns);
 
-		// Max health
-		HealthComp->RestoreHealth();
-		
-		bDeath = false;
+	// Spawn points are validated for the capsule already, teleport without sweeping
+	SetActorLocation(SpawnLocation, false, nullptr, ETeleportType::TeleportPhysics);
+	GetCharacterMovement()->StopMovementImmediately();
+	GetCharacterMovement()->SetDefaultMovementMode();
+
+	// Rewinds must not interpolate between the death and spawn locations
+	UBMLagCompensationSubsystem* lagCompensation = GetWorld()->GetSubsystem<UBMLagCompensationSubsystem>();
+	if (lagCompensation)
+	{
+		lagCompensation->ResetHistory(this);
 	}
+
+	// Max health
+	HealthComp->RestoreHealth();
+	SphereAttackComp->ResetAbility();
+
+	// Clients restore themselves in OnRep_Death
+	bDeath = false;
+	BM_MARK_PROPERTY_DIRTY(ABMGameplayServerCharacter, bDeath, this);
+	BMEntityCounts::Track(BMEntityCounts::DeadPawns, bCountedDead, bDeath);
+	ResetCharacter();
+
+	ForceNetUpdate();
 }
 
 void ABMGameplayServerCharacter::Ragdoll()
@@ -124,10 +301,10 @@ void ABMGameplayServerCharacter::Ragdoll()
 	if (IsLocallyControlled())
 	{
 		GetMesh()->SetOwnerNoSee(false);
-		TP_Gun->SetOwnerNoSee(false);
+		SetCosmeticOwnerNoSee(TP_Gun, false);
 
-		FP_Mesh->SetOwnerNoSee(true);
-		FP_Gun->SetOwnerNoSee(true);
+		SetCosmeticOwnerNoSee(FP_Mesh, true);
+		SetCosmeticOwnerNoSee(FP_Gun, true);
 
 		// Disable input temporally
 		ActivateDeathMode();
@@ -136,17 +313,18 @@ void ABMGameplayServerCharacter::Ragdoll()
 
 void ABMGameplayServerCharacter::ResetCharacter()
 {
-	GetMesh()->AttachTo(GetCapsuleComponent(), NAME_None, EAttachLocation::SnapToTarget, true);
 	GetMesh()->SetSimulatePhysics(false);
+	GetMesh()->AttachToComponent(GetCapsuleComponent(), FAttachmentTransformRules::SnapToTargetNotIncludingScale);
+	GetMesh()->SetRelativeLocationAndRotation(GetBaseTranslationOffset(), GetBaseRotationOffset());
 	GetMesh()->SetCollisionProfileName("CharacterMesh");
 
 	if (IsLocallyControlled())
 	{
 		GetMesh()->SetOwnerNoSee(true);
-		TP_Gun->SetOwnerNoSee(true);
+		SetCosmeticOwnerNoSee(TP_Gun, true);
 
-		FP_Mesh->SetOwnerNoSee(false);
-		FP_Gun->SetOwnerNoSee(false);
+		SetCosmeticOwnerNoSee(FP_Mesh, false);
+		SetCosmeticOwnerNoSee(FP_Gun, false);
 
 		// Enable input
 		DeactivateDeathMode();
@@ -159,12 +337,136 @@ void ABMGameplayServerCharacter::BeginPlay()
 	Super::BeginPlay();
 
 	//Attach gun mesh component to Skeleton, doing it here because the skeleton is not yet created in the constructor
-	FP_Gun->AttachToComponent(FP_Mesh, FAttachmentTransformRules(EAttachmentRule::SnapToTarget, true), TEXT("GripPoint"));
-	FP_Mesh->SetHiddenInGame(false, true);
-	TP_Gun->SetOwnerNoSee(true);
+	if (FP_Gun && FP_Mesh)
+	{
+		FP_Gun->AttachToComponent(FP_Mesh, FAttachmentTransformRules(EAttachmentRule::SnapToTarget, true), TEXT("GripPoint"));
+		FP_Mesh->SetHiddenInGame(false, true);
+	}
+	SetCosmeticOwnerNoSee(TP_Gun, true);
 	GetMesh()->SetOwnerNoSee(true);
+
+	ApplyServerAnimationPolicy();
+
+	// Warm the projectile pool before the first shot
+	UBMProjectileBatchSubsystem* batch = GetWorld()->GetSubsystem<UBMProjectileBatchSubsystem>();
+	if (GetLocalRole() == ROLE_Authority && ProjectileClass != NULL && !(batch && batch->IsEnabled()))
+	{
+		UBMProjectilePoolSubsystem* pool = GetWorld()->GetSubsystem<UBMProjectilePoolSubsystem>();
+		if (pool)
+		{
+			pool->Prewarm(ProjectileClass);
+		}
+	}
+
+	// Record capsule history for hit validation
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		UBMLagCompensationSubsystem* lagCompensation = GetWorld()->GetSubsystem<UBMLagCompensationSubsystem>();
+		if (lagCompensation)
+		{
+			lagCompensation->RegisterCharacter(this);
+		}
+	}
+
+	// Area of effect queries on every machine go through the spatial grid
+	UBMPawnSpatialGrid* spatialGrid = GetWorld()->GetSubsystem<UBMPawnSpatialGrid>();
+	if (spatialGrid)
+	{
+		spatialGrid->RegisterCharacter(this);
+	}
+}
+
+void ABMGameplayServerCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UBMLagCompensationSubsystem* lagCompensation = GetWorld()->GetSubsystem<UBMLagCompensationSubsystem>();
+	if (lagCompensation)
+	{
+		lagCompensation->UnregisterCharacter(this);
+	}
+
+	UBMPawnSpatialGrid* spatialGrid = GetWorld()->GetSubsystem<UBMPawnSpatialGrid>();
+	if (spatialGrid)
+	{
+		spatialGrid->UnregisterCharacter(this);
+	}
+
+	if (bSkippingServerPose)
+	{
+		const uint64 skippedFrames = GFrameCounter - ServerPoseSkipStartFrame;
+		BMServerAnimation::EndedSkippedFrames += skippedFrames;
+		BMServerAnimation::EndedSkippedSeconds += skippedFrames * BMServerAnimation::GetReferencePoseSeconds(GetClass());
+		DEC_DWORD_STAT(STAT_BMServerMeshesSkippingPose);
+		bSkippingServerPose = false;
+	}
+
+	BMEntityCounts::Track(BMEntityCounts::DeadPawns, bCountedDead, false);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ABMGameplayServerCharacter::ApplyServerAnimationPolicy()
+{
+	if (GetNetMode() != NM_DedicatedServer || ServerAnimationPolicy != EBMServerAnimationPolicy::OnDemand)
+	{
+		return;
+	}
+
+	// Price a skipped frame with real evaluations of the first characters of each class, before the
+	// mesh stops ticking. The first evaluation of a fresh anim instance initializes it, only the second is timed
+	USkeletalMeshComponent* mesh = GetMesh();
+	BMServerAnimation::FReferencePose& reference = BMServerAnimation::ReferencePoses.FindOrAdd(GetClass());
+	if (reference.Samples < BMServerAnimation::MaxReferenceSamples)
+	{
+		const float deltaSeconds = GetWorld()->GetDeltaSeconds();
+		mesh->TickAnimation(deltaSeconds, false);
+		mesh->RefreshBoneTransforms();
+
+		const double startTime = FPlatformTime::Seconds();
+		mesh->TickAnimation(deltaSeconds, false);
+		mesh->RefreshBoneTransforms();
+		reference.Seconds += FPlatformTime::Seconds() - startTime;
+		reference.Samples++;
+	}
+
+	// Ragdolls only run on clients, nothing on the server reads the pose every frame
+	mesh->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+	mesh->SetComponentTickEnabled(false);
+
+	bSkippingServerPose = true;
+	ServerPoseSkipStartFrame = GFrameCounter;
+	INC_DWORD_STAT(STAT_BMServerMeshesSkippingPose);
 }
 
+/**
+ * bm.ServerAnim.Report
+ * Logs how many third person mesh frames were not evaluated on this server and an estimate of the
+ * time that saved. A skipped frame is priced at the average warm pose evaluation of the first
+ * characters of its class, timed when they started skipping.
+ */
+static FAutoConsoleCommandWithWorld BMServerAnimReportCommand(
+	TEXT("bm.ServerAnim.Report"),
+	TEXT("Logs skipped server pose evaluations and the estimated animation time saved."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		uint64 skippedFrames = BMServerAnimation::EndedSkippedFrames;
+		double skippedSeconds = BMServerAnimation::EndedSkippedSeconds;
+		int32 skippingMeshes = 0;
+		for (TActorIterator<ABMGameplayServerCharacter> It(World); It; ++It)
+		{
+			const uint64 characterSkippedFrames = It->GetServerPoseSkippedFrames();
+			if (characterSkippedFrames > 0)
+			{
+				skippedFrames += characterSkippedFrames;
+				skippedSeconds += characterSkippedFrames * BMServerAnimation::GetReferencePoseSeconds(It->GetClass());
+				skippingMeshes++;
+			}
+		}
+
+		const double referencePoseSeconds = skippedFrames > 0 ? skippedSeconds / skippedFrames : 0.0;
+		UE_LOG(LogBMGameplay, Display, TEXT("Server animation: %d meshes skipping pose, %llu mesh frames skipped (%.3f ms reference pose), ~%.1f ms saved"),
+			skippingMeshes, skippedFrames, referencePoseSeconds * 1000.0, skippedSeconds * 1000.0);
+	}));
+
 //////////////////////////////////////////////////////////////////////////
 // Input
 
@@ -202,15 +504,387 @@ void ABMGameplayServerCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProp
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
 	//Replicate current health.
-	DOREPLIFETIME(ABMGameplayServerCharacter, bDeath);
+	BM_DOREPLIFETIME_PUSH(ABMGameplayServerCharacter, bDeath, COND_None);
+	BM_DOREPLIFETIME_PUSH(ABMGameplayServerCharacter, LastAckedShot, COND_OwnerOnly);
+}
+
+void ABMGameplayServerCharacter::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	UBMNetReportSubsystem* netReport = GetWorld()->GetSubsystem<UBMNetReportSubsystem>();
+	if (netReport && netReport->IsEnabled())
+	{
+		netReport->NotePreReplication(this);
+	}
+}
+
+bool ABMGameplayServerCharacter::ReplicateSubobjects(UActorChannel* Channel, FOutBunch* Bunch, FReplicationFlags* RepFlags)
+{
+	check(Channel);
+	check(Bunch);
+	check(RepFlags);
+
+	bool wroteSomething = false;
+	for (UActorComponent* component : GetReplicatedComponents())
+	{
+		if (component && component->GetIsReplicated())
+		{
+			// Skipped health is not compared at all, the channel sends what it missed on the next change
+			if (component == HealthComp && !HealthComp->ConsiderForReplication(RepFlags->bNetInitial))
+			{
+				continue;
+			}
+
+			wroteSomething |= component->ReplicateSubobjects(Channel, Bunch, RepFlags);
+			wroteSomething |= Channel->ReplicateSubobject(component, *Bunch, *RepFlags);
+		}
+	}
+	return wroteSomething;
 }
 
 void ABMGameplayServerCharacter::OnFire()
 {
 	// try fire a projectile
-	if (ProjectileClass != NULL)
+	if (ProjectileClass == NULL)
+	{
+		return;
+	}
+
+	if (!bNativeFire)
 	{
 		OnFireBP();
+		return;
+	}
+
+	// Faster than the server accepts would only show shots that never happen
+	const float now = GetWorld()->GetTimeSeconds();
+	if (now - LastFireTime < MinRefireInterval)
+	{
+		return;
+	}
+	LastFireTime = now;
+
+	const FTransform muzzle = GetMuzzleTransform();
+
+	// Every shot gets a sequence number, never 0 so it can't be mistaken for an unpredicted one
+	FBMFireShot shot;
+	shot.Sequence = ++LastShotId;
+	if (shot.Sequence == 0)
+	{
+		shot.Sequence = ++LastShotId;
+	}
+	shot.Origin = muzzle.GetLocation();
+	shot.Direction = muzzle.GetRotation().GetForwardVector();
+
+	PlayFireEffects();
+
+	// Listen server host fires directly
+	if (GetLocalRole() == ROLE_Authority)
+	{
+		FireShot(shot);
+		return;
+	}
+
+	// Batched projectiles are already simulated by clients from the spawn event
+	UBMProjectileBatchSubsystem* batch = GetWorld()->GetSubsystem<UBMProjectileBatchSubsystem>();
+	if (bPredictProjectiles && !(batch && batch->IsEnabled()))
+	{
+		PurgeUnconfirmedShots();
+
+		// Cosmetic only, flagged before BeginPlay so it never deals damage
+		ABMGameplayServerProjectile* predicted = GetWorld()->SpawnActorDeferred<ABMGameplayServerProjectile>(ProjectileClass, muzzle, this, this, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		if (predicted)
+		{
+			predicted->SetPredicted();
+			predicted->FinishSpawning(muzzle);
+		}
+
+		FBMPredictedShot& predictedShot = PredictedShots.Add(shot.Sequence);
+		predictedShot.Projectile = predicted;
+		predictedShot.Origin = shot.Origin;
+		predictedShot.Direction = shot.Direction;
+		predictedShot.FireTime = GetWorld()->GetTimeSeconds();
+
+		BMFirePrediction::NumPredicted++;
+		INC_DWORD_STAT(STAT_BMPredictedShots);
+	}
+
+	// Resend what the server hasn't acknowledged yet along with the new shot
+	for (int32 i = UnackedShots.Num() - 1; i >= 0; --i)
+	{
+		if (!BMFirePrediction::IsNewerShot(UnackedShots[i].Sequence, LastAckedShot))
+		{
+			UnackedShots.RemoveAt(i, 1, false);
+		}
+	}
+	UnackedShots.Add(shot);
+	if (UnackedShots.Num() > RedundantShotCount + 1)
+	{
+		UnackedShots.RemoveAt(0, UnackedShots.Num() - (RedundantShotCount + 1), false);
+	}
+
+	ServerFireShots(UnackedShots);
+}
+
+void ABMGameplayServerCharacter::ServerFireShots_Implementation(const TArray<FBMFireShot>& Shots)
+{
+	// One shot per refire interval, banked up to a full redundant batch so shots resent after loss
+	// or bunched up by jitter still fire, while any sustained rate above the weapon's is dropped
+	const float now = GetWorld()->GetTimeSeconds();
+	if (MinRefireInterval > 0.0f)
+	{
+		ShotBudget = FMath::Min(ShotBudget + (now - ShotBudgetTime) / MinRefireInterval, float(RedundantShotCount + 1));
+	}
+	ShotBudgetTime = now;
+
+	// Never more than a full redundant batch, anything beyond is not from our client
+	const int32 firstShot = FMath::Max(Shots.Num() - (RedundantShotCount + 1), 0);
+	for (int32 i = firstShot; i < Shots.Num(); ++i)
+	{
+		const FBMFireShot& shot = Shots[i];
+		INC_DWORD_STAT(STAT_BMShotsReceived);
+
+		if (!BMFirePrediction::IsNewerShot(shot.Sequence, LastAckedShot))
+		{
+			BMFirePrediction::NumShotsDeduplicated++;
+			INC_DWORD_STAT(STAT_BMShotsDeduplicated);
+			continue;
+		}
+
+		// Sequences we skip over were lost with more packets than we resend
+		const uint16 lostShots = uint16(shot.Sequence - LastAckedShot - 1);
+		if (LastAckedShot != 0 && lostShots > 0)
+		{
+			BMFirePrediction::NumShotsLost += lostShots;
+			INC_DWORD_STAT_BY(STAT_BMShotsLost, lostShots);
+		}
+
+		// Only the last entry is new in a packet that arrived in order
+		if (i < Shots.Num() - 1)
+		{
+			BMFirePrediction::NumShotsRecovered++;
+			INC_DWORD_STAT(STAT_BMShotsRecovered);
+		}
+
+		// Acknowledged either way, a dropped shot must not be resent and fired later
+		LastAckedShot = shot.Sequence;
+		BM_MARK_PROPERTY_DIRTY(ABMGameplayServerCharacter, LastAckedShot, this);
+
+		if (MinRefireInterval > 0.0f)
+		{
+			if (ShotBudget < 1.0f)
+			{
+				BMFirePrediction::NumShotsRejected++;
+				INC_DWORD_STAT(STAT_BMShotsRejected);
+				continue;
+			}
+			ShotBudget -= 1.0f;
+		}
+
+		FireShot(shot);
+	}
+}
+
+void ABMGameplayServerCharacter::FireShot(const FBMFireShot& Shot)
+{
+	if (ProjectileClass == NULL || bDeath)
+	{
+		return;
+	}
+
+	// Trust the client's aim, but not a muzzle somewhere else than ours
+	FVector origin = Shot.Origin;
+	const FVector serverOrigin = GetMuzzleTransform().GetLocation();
+	const float originError = FVector::Dist(Shot.Origin, serverOrigin);
+	BMFirePrediction::NumServerShots++;
+	BMFirePrediction::TotalOriginError += originError;
+	if (originError > MaxFireOriginError)
+	{
+		origin = serverOrigin;
+		BMFirePrediction::NumOriginsCorrected++;
+		INC_DWORD_STAT(STAT_BMFireOriginsCorrected);
+	}
+
+	ABMGameplayServerProjectile* projectile = SpawnProjectile(FTransform(Shot.Direction.Rotation(), origin));
+	if (projectile)
+	{
+		projectile->SetShotId(Shot.Sequence);
+	}
+
+	MulticastFireEffects();
+}
+
+void ABMGameplayServerCharacter::MulticastFireEffects_Implementation()
+{
+	// The shooter played them when firing, a dedicated server has nothing to show
+	if (!IsLocallyControlled() && GetNetMode() != NM_DedicatedServer)
+	{
+		PlayFireEffects();
+	}
+}
+
+void ABMGameplayServerCharacter::PlayFireEffects()
+{
+	if (FireSound != NULL)
+	{
+		UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
+	}
+
+	// First person arms for the shooter, third person body for everyone else
+	USkeletalMeshComponent* animatedMesh = IsLocallyControlled() ? FP_Mesh : GetMesh();
+	UAnimMontage* fireAnimation = IsLocallyControlled() ? FP_FireAnimation : TP_FireAnimation;
+	if (animatedMesh != NULL && fireAnimation != NULL)
+	{
+		UAnimInstance* animInstance = animatedMesh->GetAnimInstance();
+		if (animInstance != NULL)
+		{
+			animInstance->Montage_Play(fireAnimation, 1.f);
+		}
+	}
+}
+
+void ABMGameplayServerCharacter::ConfirmPredictedShot(uint16 ShotId, ABMGameplayServerProjectile* AuthoritativeProjectile)
+{
+	FBMPredictedShot shot;
+	if (!PredictedShots.RemoveAndCopyValue(ShotId, shot))
+	{
+		return;
+	}
+
+	BMFirePrediction::NumConfirmed++;
+	INC_DWORD_STAT(STAT_BMPredictedShotsConfirmed);
+
+	// Where from and where to the server actually launched it, compared to our guess
+	const FVector authoritativeOrigin = AuthoritativeProjectile->GetActorLocation();
+	const FVector authoritativeDirection = AuthoritativeProjectile->GetVelocity().GetSafeNormal();
+	if (FVector::Dist(shot.Origin, authoritativeOrigin) > BMFirePrediction::DivergedDistance
+		|| (shot.Direction | authoritativeDirection) < BMFirePrediction::DivergedDirectionDot)
+	{
+		BMFirePrediction::NumDiverged++;
+		INC_DWORD_STAT(STAT_BMPredictedShotsDiverged);
+		UE_LOG(LogBMGameplay, Verbose, TEXT("Predicted shot %d diverged: origin off by %.1f cm"), ShotId, FVector::Dist(shot.Origin, authoritativeOrigin));
+	}
+
+	// Merge: the authoritative projectile continues from where the player already sees the shot
+	ABMGameplayServerProjectile* predicted = shot.Projectile.Get();
+	if (predicted)
+	{
+		if (!predicted->IsActorBeingDestroyed())
+		{
+			AuthoritativeProjectile->SetActorLocation(predicted->GetActorLocation());
+		}
+		predicted->Destroy();
+	}
+}
+
+void ABMGameplayServerCharacter::PurgeUnconfirmedShots()
+{
+	const float now = GetWorld()->GetTimeSeconds();
+	for (auto It = PredictedShots.CreateIterator(); It; ++It)
+	{
+		if (now - It.Value().FireTime > BMFirePrediction::ConfirmTimeout)
+		{
+			ABMGameplayServerProjectile* predicted = It.Value().Projectile.Get();
+			if (predicted)
+			{
+				predicted->Destroy();
+			}
+			It.RemoveCurrent();
+
+			BMFirePrediction::NumUnconfirmed++;
+			INC_DWORD_STAT(STAT_BMPredictedShotsUnconfirmed);
+		}
+	}
+}
+
+/**
+ * bm.FirePrediction.Report
+ * Logs how often the client's predicted shots and the server's agreed. Client numbers come from
+ * the owning client, origin corrections from the server.
+ */
+static FAutoConsoleCommand BMFirePredictionReportCommand(
+	TEXT("bm.FirePrediction.Report"),
+	TEXT("Logs predicted, confirmed, unconfirmed and diverged shots, and server side origin corrections and shot loss."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		UE_LOG(LogBMGameplay, Display, TEXT("Fire prediction: %llu predicted, %llu confirmed, %llu unconfirmed, %llu diverged. Server: %llu shots, %llu origins corrected, %.1f cm average origin error"),
+			BMFirePrediction::NumPredicted, BMFirePrediction::NumConfirmed, BMFirePrediction::NumUnconfirmed, BMFirePrediction::NumDiverged,
+			BMFirePrediction::NumServerShots, BMFirePrediction::NumOriginsCorrected,
+			BMFirePrediction::NumServerShots > 0 ? BMFirePrediction::TotalOriginError / BMFirePrediction::NumServerShots : 0.0);
+		UE_LOG(LogBMGameplay, Display, TEXT("Fire shots: %llu duplicates dropped, %llu recovered by resend, %llu lost, %llu over the fire rate"),
+			BMFirePrediction::NumShotsDeduplicated, BMFirePrediction::NumShotsRecovered, BMFirePrediction::NumShotsLost, BMFirePrediction::NumShotsRejected);
+	}));
+
+FTransform ABMGameplayServerCharacter::GetMuzzleTransform() const
+{
+	const FRotator spawnRotation = GetControlRotation();
+	// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
+	const FVector spawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + spawnRotation.RotateVector(GunOffset);
+	return FTransform(spawnRotation, spawnLocation);
+}
+
+void ABMGameplayServerCharacter::SetCosmeticOwnerNoSee(UPrimitiveComponent* Component, bool bNewOwnerNoSee)
+{
+	if (Component)
+	{
+		Component->SetOwnerNoSee(bNewOwnerNoSee);
+	}
+}
+
+ABMGameplayServerProjectile* ABMGameplayServerCharacter::SpawnProjectile(const FTransform& SpawnTransform)
+{
+	if (GetLocalRole() != ROLE_Authority || ProjectileClass == NULL)
+	{
+		return nullptr;
+	}
+
+	// Batched mode: no actor, clients are told to simulate it
+	UBMProjectileBatchSubsystem* batch = GetWorld()->GetSubsystem<UBMProjectileBatchSubsystem>();
+	if (batch && batch->IsEnabled())
+	{
+		const FVector origin = SpawnTransform.GetLocation();
+		const FVector direction = SpawnTransform.GetRotation().GetForwardVector();
+		const uint16 projectileId = batch->SpawnProjectile(ProjectileClass, origin, direction, this);
+		MulticastBatchedProjectileSpawn(projectileId, origin, direction);
+		return nullptr;
+	}
+
+	UBMProjectilePoolSubsystem* pool = GetWorld()->GetSubsystem<UBMProjectilePoolSubsystem>();
+	if (pool)
+	{
+		return pool->AcquireProjectile(ProjectileClass, SpawnTransform, this, this);
+	}
+
+	FActorSpawnParameters spawnParams;
+	spawnParams.Owner = this;
+	spawnParams.Instigator = this;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+	return GetWorld()->SpawnActor<ABMGameplayServerProjectile>(ProjectileClass, SpawnTransform, spawnParams);
+}
+
+void ABMGameplayServerCharacter::MulticastBatchedProjectileSpawn_Implementation(uint16 ProjectileId, FVector_NetQuantize Origin, FVector_NetQuantizeNormal Direction)
+{
+	// Server already simulates the authoritative one
+	if (GetLocalRole() < ROLE_Authority)
+	{
+		UBMProjectileBatchSubsystem* batch = GetWorld()->GetSubsystem<UBMProjectileBatchSubsystem>();
+		if (batch)
+		{
+			batch->SpawnSimulatedProjectile(ProjectileClass, ProjectileId, Origin, Direction, this);
+		}
+	}
+}
+
+void ABMGameplayServerCharacter::MulticastBatchedProjectileImpact_Implementation(uint16 ProjectileId, FVector_NetQuantize Location)
+{
+	if (GetLocalRole() < ROLE_Authority)
+	{
+		UBMProjectileBatchSubsystem* batch = GetWorld()->GetSubsystem<UBMProjectileBatchSubsystem>();
+		if (batch)
+		{
+			batch->ImpactSimulatedProjectile(ProjectileId, Location);
+		}
 	}
 }
 
@@ -226,16 +900,22 @@ void ABMGameplayServerCharacter::OnDeactivateSpell()
 
 void ABMGameplayServerCharacter::ActivateDeathMode()
 {
-	FirstPersonCameraComponent->bUsePawnControlRotation = false;
-	FirstPersonCameraComponent->SetRelativeRotation(FRotator(-45.0f, 0.0f, 0.0f));
+	if (FirstPersonCameraComponent)
+	{
+		FirstPersonCameraComponent->bUsePawnControlRotation = false;
+		FirstPersonCameraComponent->SetRelativeRotation(FRotator(-45.0f, 0.0f, 0.0f));
+	}
 
 	DisableInput(Cast<APlayerController>(GetController()));
 }
 
 void ABMGameplayServerCharacter::DeactivateDeathMode()
 {
-	FirstPersonCameraComponent->bUsePawnControlRotation = true;
-	FirstPersonCameraComponent->SetRelativeRotation(FRotator(45.0f, 0.0f, 0.0f));
+	if (FirstPersonCameraComponent)
+	{
+		FirstPersonCameraComponent->bUsePawnControlRotation = true;
+		FirstPersonCameraComponent->SetRelativeRotation(FRotator(45.0f, 0.0f, 0.0f));
+	}
 
 	EnableInput(Cast<APlayerController>(GetController()));
 }
@@ -272,12 +952,17 @@ void ABMGameplayServerCharacter::LookUpAtRate(float Rate)
 
 void ABMGameplayServerCharacter::HealthChange()
 {
+	SCOPE_CYCLE_COUNTER(STAT_BMHealthChange);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, HealthChange);
+
 	if (GetLocalRole() == ROLE_Authority)
 	{
 		// If player has died time to respawn
 		if (HealthComp->GetCurrentHealth() <= 0 && !bDeath)
 		{
 			bDeath = true;
+			BM_MARK_PROPERTY_DIRTY(ABMGameplayServerCharacter, bDeath, this);
+			BMEntityCounts::Track(BMEntityCounts::DeadPawns, bCountedDead, bDeath);
 
 			// After 10 sec respawn
 			FTimerHandle respawnTimer;
@@ -295,6 +980,8 @@ void ABMGameplayServerCharacter::HealthChange()
 
 void ABMGameplayServerCharacter::OnRep_Death()
 {
+	BMEntityCounts::Track(BMEntityCounts::DeadPawns, bCountedDead, bDeath);
+
 	if (bDeath)
 	{
 		// If death Ragdoll in clients
@@ -4,24 +4,72 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "Engine/NetSerialization.h"
 #include "BMGameplayServerCharacter.generated.h"
 
 // forwards
 class UInputComponent;
 
+/** How the third person mesh is animated on a dedicated server */
+UENUM(BlueprintType)
+enum class EBMServerAnimationPolicy : uint8
+{
+	/** Tick and evaluate the pose every frame like clients do */
+	AlwaysEvaluate,
+	/** Never tick the mesh, server gameplay only needs the capsule */
+	OnDemand,
+};
+
+/** One shot sent by the owning client, Sequence doubles as the predicted shot id */
+USTRUCT()
+struct FBMFireShot
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	uint16 Sequence = 0;
+
+	UPROPERTY()
+	FVector_NetQuantize Origin;
+
+	UPROPERTY()
+	FVector_NetQuantizeNormal Direction;
+};
+
+/** Cosmetic projectile the owning client fired ahead of the server */
+struct FBMPredictedShot
+{
+	TWeakObjectPtr<class ABMGameplayServerProjectile> Projectile;
+	FVector Origin;
+	FVector Direction;
+	float FireTime;
+};
+
 UCLASS(config=Game, BlueprintType)
 class ABMGameplayServerCharacter : public ACharacter
 {
 	GENERATED_BODY()
 
+	/** Load test bots press the same fire and spell handlers as player input */
+	friend class ABMBotController;
+
 public:
 	ABMGameplayServerCharacter();
 
 protected:
 	virtual void BeginPlay();
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void PostInitializeComponents() override;
+
 public:
 
+	/*
+	 * Cosmetic components below are destroyed on a dedicated server and are null there. The meshes
+	 * are UBMCosmeticSkeletalMeshComponents, so server builds never load their assets either
+	 */
+
 	/** Pawn mesh: 1st person view (arms; seen only by self) */
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = Mesh)
 	class USkeletalMeshComponent* FP_Mesh;
@@ -62,6 +110,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	FVector GunOffset;
 
+	/** Muzzle location relative to the capsule on a dedicated server, where the first person gun is not kept */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Gameplay)
+	FVector ServerMuzzleOffset;
+
 	/** Projectile class to spawn */
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Projectile)
 	TSubclassOf<class ABMGameplayServerProjectile> ProjectileClass;
@@ -76,6 +128,13 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	class UBMSphereAttackComponent* SphereAttackComp;
 
+	/** Third person animation on a dedicated server, the server only needs the capsule for gameplay */
+	UPROPERTY(EditDefaultsOnly, Category = Animation)
+	EBMServerAnimationPolicy ServerAnimationPolicy;
+
+	/** Mesh frames this character did not evaluate on the server so far */
+	FORCEINLINE uint64 GetServerPoseSkippedFrames() const { return bSkippingServerPose ? GFrameCounter - ServerPoseSkipStartFrame : 0; }
+
 	/** Respawn time */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
 	float RespawnTime;
@@ -83,6 +142,65 @@ public:
 	/** Property replication */
 	void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
+	/** Reports changed properties to bm.NetReport when it is tracking */
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+
+	/** Replicates components like AActor does, leaving out the health component while it is asleep */
+	virtual bool ReplicateSubobjects(class UActorChannel* Channel, class FOutBunch* Bunch, FReplicationFlags* RepFlags) override;
+
+	/**
+	 * Spawns a ProjectileClass projectile from the world projectile pool. Server only.
+	 * In batched projectiles mode no actor is spawned and nullptr is returned.
+	 */
+	UFUNCTION(BlueprintCallable, BlueprintAuthorityOnly, Category = Projectile)
+	class ABMGameplayServerProjectile* SpawnProjectile(const FTransform& SpawnTransform);
+
+	/** Fire natively with client prediction instead of going through OnFireBP */
+	UPROPERTY(EditDefaultsOnly, Category = Projectile)
+	bool bNativeFire;
+
+	/** Owning client shows its own projectile right away instead of waiting for the server's */
+	UPROPERTY(EditDefaultsOnly, Category = Projectile)
+	bool bPredictProjectiles;
+
+	/** Server accepts the client's muzzle origin up to this far from its own, in cm */
+	UPROPERTY(EditDefaultsOnly, Category = Projectile)
+	float MaxFireOriginError;
+
+	/** Unacknowledged shots resent with every new one, covers this many lost packets in a row */
+	UPROPERTY(EditDefaultsOnly, Category = Projectile, meta = (ClampMin = "0", ClampMax = "15"))
+	int32 RedundantShotCount;
+
+	/** Shortest time between two native shots, the server drops shots sent faster than this. 0 disables the limit */
+	UPROPERTY(EditDefaultsOnly, Category = Projectile, meta = (ClampMin = "0.0"))
+	float MinRefireInterval;
+
+	/**
+	 * Newest shots of the owning client, oldest first. Unreliable so lost packets never stall the
+	 * reliable sphere RPCs, shots lost with one packet arrive again with the next.
+	 */
+	UFUNCTION(Server, Unreliable)
+	void ServerFireShots(const TArray<FBMFireShot>& Shots);
+
+	/** Fire sound and animations on everyone but the shooter, who played them when firing */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastFireEffects();
+
+	/** Authoritative projectile for a predicted shot arrived, merges the predicted one into it */
+	void ConfirmPredictedShot(uint16 ShotId, class ABMGameplayServerProjectile* AuthoritativeProjectile);
+
+	/** World transform projectiles are fired from: muzzle plus GunOffset, facing the control rotation */
+	UFUNCTION(BlueprintPure, Category = Projectile)
+	FTransform GetMuzzleTransform() const;
+
+	/** Batched projectile spawned on the server, clients simulate its flight */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastBatchedProjectileSpawn(uint16 ProjectileId, FVector_NetQuantize Origin, FVector_NetQuantizeNormal Direction);
+
+	/** Batched projectile hit something on the server */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastBatchedProjectileImpact(uint16 ProjectileId, FVector_NetQuantize Location);
+
 protected:
 	
 	/** Fires a projectile. */
@@ -118,12 +236,15 @@ protected:
 	UFUNCTION()
 	void OnRep_Death();
 
+	/** Counted in BMEntityCounts::DeadPawns */
+	bool bCountedDead;
+
 protected:
 	// APawn interface
 	virtual void SetupPlayerInputComponent(UInputComponent* InputComponent) override;
 	// End of APawn interface
 
-	/* Respawn character on server at random position with navmesh */
+	/* Respawn character on server through the game mode */
 	void Respawn();
 
 	/* Activates ragdolls on clients */
@@ -138,6 +259,50 @@ protected:
 	/** Deactivate spell */
 	void OnDeactivateSpell();
 
+	/* Stops ticking the third person mesh on a dedicated server when the policy says so */
+	void ApplyServerAnimationPolicy();
+
+	/** Mesh skips pose evaluation on this server */
+	bool bSkippingServerPose;
+
+	/** Frame the mesh started skipping pose evaluation, for the saved time report */
+	uint64 ServerPoseSkipStartFrame;
+
+	/** Plays fire sound and first or third person fire animation, whichever this machine shows */
+	void PlayFireEffects();
+
+	/** Drops predicted shots the server never answered */
+	void PurgeUnconfirmedShots();
+
+	/** Predicted shots waiting for their authoritative projectile, by shot id */
+	TMap<uint16, FBMPredictedShot> PredictedShots;
+
+	/** Last shot id used, 0 is never used */
+	uint16 LastShotId;
+
+	/** Fires one shot on the server */
+	void FireShot(const FBMFireShot& Shot);
+
+	/** Shots not acknowledged by the server yet, oldest first. Owning client only */
+	TArray<FBMFireShot> UnackedShots;
+
+	/** World time of the last native shot fired locally */
+	float LastFireTime;
+
+	/** Shots the server still accepts right now, refilled at one per MinRefireInterval. Server only */
+	float ShotBudget;
+	float ShotBudgetTime;
+
+	/** Newest shot the server fired, acknowledges it and everything before to the owning client */
+	UPROPERTY(Replicated)
+	uint16 LastAckedShot;
+
+	/* Destroys the camera, first person arms and gun meshes, and moves the muzzle to the capsule */
+	void StripCosmeticComponents();
+
+	/* SetOwnerNoSee on a cosmetic component that may not exist */
+	static void SetCosmeticOwnerNoSee(class UPrimitiveComponent* Component, bool bNewOwnerNoSee);
+
 	/* Activate death camera mode */
 	void ActivateDeathMode();
 
@@ -155,6 +320,12 @@ public:
 	UFUNCTION()
 	void HealthChange();
 
+	/** Waiting to respawn */
+	FORCEINLINE bool IsDead() const { return bDeath; }
+
+	/** Brings the character back to life at SpawnLocation, reusing this actor instead of spawning a new one. Server only */
+	void ResetForRespawn(const FVector& SpawnLocation);
+
 	/** Client widget update events */
 
 	// Health change event
@@ -5,8 +5,12 @@
 #include "BMGameplayServerCharacter.h"
 #include "UObject/ConstructorHelpers.h"
 #include "Engine/World.h"
-#include "BMHealthComponent.h"
-#include "NavigationSystem.h"
+#include "BMSpawnPointSubsystem.h"
+#include "BMBotController.h"
+#include "BMGameplayServer.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Game mode respawn"), STAT_BMGameModeRespawn, STATGROUP_BMGameplay);
 
 ABMGameplayServerGameMode::ABMGameplayServerGameMode()
 	: Super()
@@ -19,24 +23,142 @@ ABMGameplayServerGameMode::ABMGameplayServerGameMode()
 	HUDClass = ABMGameplayServerHUD::StaticClass();
 }
 
+void ABMGameplayServerGameMode::StartPlay()
+{
+	Super::StartPlay();
+
+	// -bots=N fills a headless server for load tests
+	int32 numBots = 0;
+	if (FParse::Value(FCommandLine::Get(), TEXT("bots="), numBots) && numBots > 0)
+	{
+		UE_LOG(LogBMGameplay, Display, TEXT("Spawned %d of %d load test bots"), SpawnBots(numBots), numBots);
+	}
+}
+
 void ABMGameplayServerGameMode::Respawn(ABMGameplayServerCharacter* Character)
 {
-	if (GetLocalRole() == ROLE_Authority)
+	if (Character == nullptr)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_BMGameModeRespawn);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, GameModeRespawn);
+
+	// Reuse the dead pawn, constructing a character is far more expensive than resetting one
+	FVector spawnLocation = Character->GetActorLocation();
+	UBMSpawnPointSubsystem* spawnPoints = GetWorld()->GetSubsystem<UBMSpawnPointSubsystem>();
+	if (spawnPoints)
 	{
-		AController* thisPC = Character->GetController();
-		Character->DetachFromControllerPendingDestroy();
-		FTransform transform = Character->GetTransform();
-		
-		UNavigationSystemV1* navSys = UNavigationSystemV1::GetCurrent(GetWorld());
-		FNavLocation navLocation;
-		navSys->GetRandomPoint(navLocation);
-		transform.SetLocation(navLocation.Location);
-		
-		ABMGameplayServerCharacter* newChar = Cast<ABMGameplayServerCharacter>(GetWorld()->SpawnActor(DefaultPawnClass, &transform));
-		if (newChar)
-		{
-			thisPC->Possess(newChar);
-			newChar->HealthComp->RestoreHealth();
+		spawnPoints->FindSpawnLocation(Character, spawnLocation);
+	}
+
+	Character->ResetForRespawn(spawnLocation);
+}
+
+int32 ABMGameplayServerGameMode::SpawnBots(int32 Count)
+{
+	UBMSpawnPointSubsystem* spawnPoints = GetWorld()->GetSubsystem<UBMSpawnPointSubsystem>();
+
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	int32 spawned = 0;
+	for (int32 i = 0; i < Count; ++i)
+	{
+		FTransform transform = FTransform::Identity;
+		FVector spawnLocation;
+		if (spawnPoints && spawnPoints->FindSpawnLocation(nullptr, spawnLocation))
+		{
+			transform.SetLocation(spawnLocation);
+		}
+
+		APawn* bot = GetWorld()->SpawnActor<APawn>(DefaultPawnClass, transform, spawnParams);
+		ABMBotController* controller = bot ? GetWorld()->SpawnActor<ABMBotController>(spawnParams) : nullptr;
+		if (controller)
+		{
+			controller->Possess(bot);
+			spawned++;
+		}
+		else if (bot)
+		{
+			bot->Destroy();
 		}
 	}
+	return spawned;
 }
+
+/**
+ * bm.Bots.Add [Count]
+ * Adds load test bots to the running server.
+ */
+static FAutoConsoleCommandWithWorldAndArgs BMBotsAddCommand(
+	TEXT("bm.Bots.Add"),
+	TEXT("Spawns load test bots on the server. Usage: bm.Bots.Add [Count]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		ABMGameplayServerGameMode* GameMode = World ? World->GetAuthGameMode<ABMGameplayServerGameMode>() : nullptr;
+		if (GameMode == nullptr)
+		{
+			UE_LOG(LogBMGameplay, Warning, TEXT("bm.Bots.Add needs a server running ABMGameplayServerGameMode"));
+			return;
+		}
+
+		const int32 Count = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1;
+		UE_LOG(LogBMGameplay, Display, TEXT("Spawned %d of %d load test bots"), GameMode->SpawnBots(Count), Count);
+	}));
+
+/**
+ * bm.Respawn.Benchmark [Count]
+ * Times spawning and destroying the default pawn against resetting one in place, the cost the
+ * in place respawn saves per death. Spawns a throwaway character far from the play area.
+ */
+static FAutoConsoleCommandWithWorldAndArgs BMRespawnBenchmarkCommand(
+	TEXT("bm.Respawn.Benchmark"),
+	TEXT("Times SpawnActor plus Destroy of the default pawn against an in place respawn. Usage: bm.Respawn.Benchmark [Count]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		ABMGameplayServerGameMode* GameMode = World ? World->GetAuthGameMode<ABMGameplayServerGameMode>() : nullptr;
+		if (GameMode == nullptr || GameMode->DefaultPawnClass == nullptr)
+		{
+			UE_LOG(LogBMGameplay, Warning, TEXT("bm.Respawn.Benchmark needs a server running ABMGameplayServerGameMode"));
+			return;
+		}
+
+		const int32 Count = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100;
+		const FTransform Transform(FVector(0.0f, 0.0f, -100000.0f));
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		double SpawnSeconds = 0.0;
+		for (int32 i = 0; i < Count; ++i)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			AActor* Spawned = World->SpawnActor(GameMode->DefaultPawnClass, &Transform, SpawnParams);
+			if (Spawned)
+			{
+				Spawned->Destroy();
+			}
+			SpawnSeconds += FPlatformTime::Seconds() - StartTime;
+		}
+
+		ABMGameplayServerCharacter* Character = Cast<ABMGameplayServerCharacter>(World->SpawnActor(GameMode->DefaultPawnClass, &Transform, SpawnParams));
+		if (Character == nullptr)
+		{
+			UE_LOG(LogBMGameplay, Warning, TEXT("bm.Respawn.Benchmark: default pawn is not an ABMGameplayServerCharacter"));
+			return;
+		}
+
+		double ResetSeconds = 0.0;
+		for (int32 i = 0; i < Count; ++i)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			Character->ResetForRespawn(Transform.GetLocation());
+			ResetSeconds += FPlatformTime::Seconds() - StartTime;
+		}
+		Character->Destroy();
+
+		UE_LOG(LogBMGameplay, Display, TEXT("Respawn benchmark (%d iterations): spawn + destroy %.3f ms, in place reset %.3f ms per respawn, %.1fx"),
+			Count, SpawnSeconds * 1000.0 / Count, ResetSeconds * 1000.0 / Count, ResetSeconds > 0.0 ? SpawnSeconds / ResetSeconds : 0.0);
+	}));
@@ -14,8 +14,13 @@ class ABMGameplayServerGameMode : public AGameModeBase
 public:
 	ABMGameplayServerGameMode();
 
+	virtual void StartPlay() override;
+
 	void Respawn(class ABMGameplayServerCharacter* Character);
 
+	/** Spawns load test bots at cached spawn points, returns how many were spawned */
+	int32 SpawnBots(int32 Count);
+
 };
 
 
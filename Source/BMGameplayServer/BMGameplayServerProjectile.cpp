@@ -3,8 +3,19 @@
 #include "BMGameplayServerProjectile.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "Net/UnrealNetwork.h"
+#include "Engine/World.h"
+#include "BMProjectilePoolSubsystem.h"
+#include "BMLagCompensationSubsystem.h"
+#include "BMGameplayServerCharacter.h"
+#include "BMDamageQueueSubsystem.h"
+#include "BMNetReportSubsystem.h"
+#include "BMGameplayServer.h"
 
-ABMGameplayServerProjectile::ABMGameplayServerProjectile() 
+DECLARE_CYCLE_STAT(TEXT("Projectile hit"), STAT_BMProjectileHit, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectile hits"), STAT_BMProjectileHits, STATGROUP_BMGameplay);
+
+ABMGameplayServerProjectile::ABMGameplayServerProjectile()
 {
 	// Use a sphere as a simple collision representation
 	CollisionComp = CreateDefaultSubobject<USphereComponent>(TEXT("SphereComp"));
@@ -30,25 +41,297 @@ ABMGameplayServerProjectile::ABMGameplayServerProjectile()
 	// Die after 3 seconds by default
 	InitialLifeSpan = 3.0f;
 
+	// Only lag compensated flights tick, on the server
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
 	Damage = 10.0f;
+
+	bPooled = false;
+	bPredicted = false;
+	bCountedLive = false;
+	bLagCompensated = false;
+	RewindSeconds = 0.0f;
+	LagCompensationStart = FVector::ZeroVector;
+}
+
+void ABMGameplayServerProjectile::BeginPlay()
+{
+	Super::BeginPlay();
+
+	BMEntityCounts::Track(BMEntityCounts::LiveProjectiles, bCountedLive, !LaunchInfo.bParked);
+
+	// Sweep the step the movement just made
+	AddTickPrerequisiteComponent(ProjectileMovement);
+
+	// Spawned outside the pool, pooled ones start in ActivateFromPool
+	if (!bPooled && !LaunchInfo.bParked)
+	{
+		StartLagCompensation();
+	}
+}
+
+void ABMGameplayServerProjectile::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (!bLagCompensated || LaunchInfo.bParked)
+	{
+		return;
+	}
+
+	// Crossed where the shooter saw a character at this point of the flight
+	const FVector location = GetActorLocation();
+	ABMGameplayServerCharacter* rewoundCharacter = SweepRewoundCapsules(location);
+	if (rewoundCharacter)
+	{
+		HitTarget(rewoundCharacter);
+		return;
+	}
+
+	LagCompensationStart = location;
+}
+
+void ABMGameplayServerProjectile::StartLagCompensation()
+{
+	UBMLagCompensationSubsystem* lagCompensation = GetWorld()->GetSubsystem<UBMLagCompensationSubsystem>();
+	bLagCompensated = GetLocalRole() == ROLE_Authority && !bPredicted && lagCompensation && lagCompensation->IsEnabled();
+	if (bLagCompensated)
+	{
+		RewindSeconds = GetWorld()->GetTimeSeconds() - lagCompensation->GetViewTime(GetInstigatorController());
+		LagCompensationStart = GetActorLocation();
+	}
+
+	// Compensated flights only hit characters at their rewound capsules, like batched projectiles
+	const ABMGameplayServerProjectile* defaultProjectile = GetClass()->GetDefaultObject<ABMGameplayServerProjectile>();
+	CollisionComp->SetCollisionResponseToChannel(ECC_Pawn, bLagCompensated ? ECR_Ignore : defaultProjectile->CollisionComp->GetCollisionResponseToChannel(ECC_Pawn));
+
+	SetActorTickEnabled(bLagCompensated);
+}
+
+ABMGameplayServerCharacter* ABMGameplayServerProjectile::SweepRewoundCapsules(const FVector& End) const
+{
+	UBMLagCompensationSubsystem* lagCompensation = GetWorld()->GetSubsystem<UBMLagCompensationSubsystem>();
+	if (lagCompensation == nullptr)
+	{
+		return nullptr;
+	}
+
+	// The shooter's view moves forward with the flight: fire view time plus time in flight
+	FVector rewoundHitLocation;
+	const float rewoundTime = GetWorld()->GetTimeSeconds() - RewindSeconds;
+	return lagCompensation->SweepSphere(LagCompensationStart, End, CollisionComp->GetScaledSphereRadius(), rewoundTime, GetInstigator(), rewoundHitLocation);
+}
+
+void ABMGameplayServerProjectile::HitTarget(AActor* Target)
+{
+	UBMDamageQueueSubsystem::QueueOrApplyDamage(Target, Damage, GetInstigatorController(), GetInstigator());
+	Recycle();
+}
+
+void ABMGameplayServerProjectile::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	BMEntityCounts::Track(BMEntityCounts::LiveProjectiles, bCountedLive, false);
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void ABMGameplayServerProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
-	if (GetLocalRole() == ROLE_Authority)
+	// Parked projectiles have no collision, ignore late notifies
+	if (LaunchInfo.bParked)
 	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_BMProjectileHit);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, ProjectileHit);
+	INC_DWORD_STAT(STAT_BMProjectileHits);
+
+	// Recycling stops the movement, keep the impact velocity for the impulse below
+	const FVector ImpactVelocity = GetVelocity();
+	const FVector ImpactLocation = GetActorLocation();
+
+	// Predicted projectiles are client spawned, so locally authoritative, but only cosmetic
+	if (GetLocalRole() == ROLE_Authority && !bPredicted)
+	{
+		// Crossed where the shooter saw a character earlier this frame, earlier frames were tested in Tick.
+		// Current capsules never count, pawns are ignored but anything else on the character is not
+		if (bLagCompensated)
+		{
+			ABMGameplayServerCharacter* rewoundCharacter = SweepRewoundCapsules(Hit.Location);
+			if (rewoundCharacter)
+			{
+				OtherActor = rewoundCharacter;
+			}
+			else if (Cast<ABMGameplayServerCharacter>(OtherActor))
+			{
+				OtherActor = nullptr;
+			}
+			LagCompensationStart = Hit.Location;
+		}
+
 		if ((OtherActor != NULL) && (OtherActor != this) && (GetInstigator() != OtherActor))
 		{
-			FDamageEvent DamageEvent;
-			OtherActor->TakeDamage(Damage, DamageEvent, GetInstigatorController(), GetInstigator());
-			Destroy(true, true);
+			HitTarget(OtherActor);
 		}
 	}
 
 	if ((OtherActor != NULL) && (OtherActor != this) && (OtherComp != NULL) && OtherComp->IsSimulatingPhysics())
 	{
-		OtherComp->AddImpulseAtLocation(GetVelocity() * 10.0f, GetActorLocation());
+		OtherComp->AddImpulseAtLocation(ImpactVelocity * 10.0f, ImpactLocation);
+
+		Recycle();
+	}
+}
+
+void ABMGameplayServerProjectile::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	BM_DOREPLIFETIME_PUSH(ABMGameplayServerProjectile, LaunchInfo, COND_None);
+}
+
+void ABMGameplayServerProjectile::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	UBMNetReportSubsystem* NetReport = GetWorld()->GetSubsystem<UBMNetReportSubsystem>();
+	if (NetReport && NetReport->IsEnabled())
+	{
+		NetReport->NotePreReplication(this);
+	}
+}
+
+void ABMGameplayServerProjectile::LifeSpanExpired()
+{
+	if (bPooled)
+	{
+		// Server parks it, clients wait for the replicated deactivation
+		if (GetLocalRole() == ROLE_Authority)
+		{
+			Recycle();
+		}
+		return;
+	}
+
+	Super::LifeSpanExpired();
+}
+
+void ABMGameplayServerProjectile::ActivateFromPool(const FTransform& SpawnTransform, AActor* NewOwner, APawn* NewInstigator)
+{
+	SetOwner(NewOwner);
+	SetInstigator(NewInstigator);
+
+	// Wake the channel before changing replicated state
+	SetNetDormancy(DORM_Awake);
 
+	LaunchInfo.Generation++;
+	LaunchInfo.bParked = false;
+	LaunchInfo.Location = SpawnTransform.GetLocation();
+	LaunchInfo.Velocity = SpawnTransform.GetRotation().GetForwardVector() * ProjectileMovement->InitialSpeed;
+	LaunchInfo.ShotId = 0;
+	BM_MARK_PROPERTY_DIRTY(ABMGameplayServerProjectile, LaunchInfo, this);
+	ApplyLaunchInfo();
+
+	SetLifeSpan(InitialLifeSpan);
+	StartLagCompensation();
+	ForceNetUpdate();
+}
+
+void ABMGameplayServerProjectile::DeactivateToPool()
+{
+	LaunchInfo.bParked = true;
+	BM_MARK_PROPERTY_DIRTY(ABMGameplayServerProjectile, LaunchInfo, this);
+	ApplyLaunchInfo();
+
+	bLagCompensated = false;
+	SetActorTickEnabled(false);
+
+	SetLifeSpan(0.0f);
+	SetOwner(nullptr);
+	SetInstigator(nullptr);
+
+	// Send the deactivation and let the channel go dormant until next reuse
+	ForceNetUpdate();
+	SetNetDormancy(DORM_DormantAll);
+}
+
+void ABMGameplayServerProjectile::Recycle()
+{
+	if (!bPooled)
+	{
 		Destroy();
+		return;
+	}
+
+	if (GetLocalRole() == ROLE_Authority && !LaunchInfo.bParked)
+	{
+		UBMProjectilePoolSubsystem* Pool = GetWorld()->GetSubsystem<UBMProjectilePoolSubsystem>();
+		if (Pool)
+		{
+			Pool->ReleaseProjectile(this);
+		}
+		else
+		{
+			DeactivateToPool();
+		}
+	}
+}
+
+void ABMGameplayServerProjectile::SetShotId(uint16 ShotId)
+{
+	// Spawned outside the pool: LaunchInfo now replicates, so it has to describe the real launch
+	if (!bPooled)
+	{
+		LaunchInfo.Location = GetActorLocation();
+		LaunchInfo.Velocity = ProjectileMovement->Velocity;
+	}
+
+	LaunchInfo.ShotId = ShotId;
+	BM_MARK_PROPERTY_DIRTY(ABMGameplayServerProjectile, LaunchInfo, this);
+}
+
+void ABMGameplayServerProjectile::OnRep_LaunchInfo()
+{
+	ApplyLaunchInfo();
+
+	// Hand the shooter's predicted copy over to this one
+	if (!LaunchInfo.bParked && LaunchInfo.ShotId != 0)
+	{
+		ABMGameplayServerCharacter* Shooter = Cast<ABMGameplayServerCharacter>(GetInstigator());
+		if (Shooter && Shooter->IsLocallyControlled())
+		{
+			Shooter->ConfirmPredictedShot(LaunchInfo.ShotId, this);
+		}
+	}
+}
+
+void ABMGameplayServerProjectile::ApplyLaunchInfo()
+{
+	// Before BeginPlay the spawn is still being set up, BeginPlay counts it
+	if (HasActorBegunPlay())
+	{
+		BMEntityCounts::Track(BMEntityCounts::LiveProjectiles, bCountedLive, !LaunchInfo.bParked);
+	}
+
+	if (!LaunchInfo.bParked)
+	{
+		SetActorLocationAndRotation(LaunchInfo.Location, LaunchInfo.Velocity.Rotation(), false, nullptr, ETeleportType::ResetPhysics);
+		SetActorHiddenInGame(false);
+		SetActorEnableCollision(true);
+
+		// A stopped projectile movement drops its updated component, restore it
+		ProjectileMovement->SetUpdatedComponent(CollisionComp);
+		ProjectileMovement->Velocity = LaunchInfo.Velocity;
+		ProjectileMovement->UpdateComponentVelocity();
+		ProjectileMovement->SetComponentTickEnabled(true);
+	}
+	else
+	{
+		ProjectileMovement->StopMovementImmediately();
+		ProjectileMovement->SetComponentTickEnabled(false);
+		SetActorHiddenInGame(true);
+		SetActorEnableCollision(false);
 	}
 }
@@ -4,8 +4,34 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Engine/NetSerialization.h"
 #include "BMGameplayServerProjectile.generated.h"
 
+/** Launch state of a pooled projectile, replicated so clients can reset their copy on reuse */
+USTRUCT()
+struct FBMProjectileLaunchInfo
+{
+	GENERATED_BODY()
+
+	/** Bumped every time the projectile is handed out by the pool */
+	UPROPERTY()
+	uint8 Generation = 0;
+
+	/** Projectile is parked in the pool: hidden, no collision and no movement */
+	UPROPERTY()
+	bool bParked = false;
+
+	UPROPERTY()
+	FVector_NetQuantize Location;
+
+	UPROPERTY()
+	FVector_NetQuantize10 Velocity;
+
+	/** Client shot this projectile answers, 0 when the shot was not predicted */
+	UPROPERTY()
+	uint16 ShotId = 0;
+};
+
 UCLASS(config=Game)
 class ABMGameplayServerProjectile : public AActor
 {
@@ -31,10 +57,92 @@ public:
 	/** Returns ProjectileMovement subobject **/
 	FORCEINLINE class UProjectileMovementComponent* GetProjectileMovement() const { return ProjectileMovement; }
 
+	/** Property replication */
+	void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	/** Reports changed properties to bm.NetReport when it is tracking */
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Tests the last movement step against rewound capsules. Server only, ticks after ProjectileMovement */
+	virtual void Tick(float DeltaSeconds) override;
+
+	/** Pooled projectiles are recycled on expiry instead of destroyed */
+	virtual void LifeSpanExpired() override;
+
+	/** Puts the projectile back in flight at the given transform. Server only, called by the pool */
+	void ActivateFromPool(const FTransform& SpawnTransform, AActor* NewOwner, APawn* NewInstigator);
+
+	/** Parks the projectile: hidden, no collision, no movement and net dormant. Server only, called by the pool */
+	void DeactivateToPool();
+
+	/** Returns the projectile to its pool, or destroys it when it was not spawned by one */
+	void Recycle();
+
+	/** Set by the pool subsystem on projectiles it owns */
+	FORCEINLINE void SetPooled(bool bInPooled) { bPooled = bInPooled; }
+
+	FORCEINLINE bool IsPooled() const { return bPooled; }
+
+	/** Projectile is parked in the pool */
+	FORCEINLINE bool IsParked() const { return LaunchInfo.bParked; }
+
+	/** Tags the projectile with the predicted client shot it answers. Server only, right after spawning */
+	void SetShotId(uint16 ShotId);
+
+	/** Marks a client side cosmetic projectile: no gameplay effects, destroyed instead of pooled */
+	FORCEINLINE void SetPredicted() { bPredicted = true; }
+
+	FORCEINLINE bool IsPredicted() const { return bPredicted; }
+
+	/** Returns base damage **/
+	FORCEINLINE float GetDamage() const { return Damage; }
+
 protected:
 
 	/** Base damage */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Projectile)
 	float Damage;
-};
 
+	/** Replicated launch state for pooled projectiles */
+	UPROPERTY(ReplicatedUsing = OnRep_LaunchInfo)
+	FBMProjectileLaunchInfo LaunchInfo;
+
+	/** RepNotify for pool activation / deactivation */
+	UFUNCTION()
+	void OnRep_LaunchInfo();
+
+	/** Applies LaunchInfo to the local actor and its components */
+	void ApplyLaunchInfo();
+
+	/** Starts testing the flight against rewound capsules, at the time the shooter saw them plus the flight time */
+	void StartLagCompensation();
+
+	/** First character whose rewound capsule the path from LagCompensationStart to End crossed */
+	class ABMGameplayServerCharacter* SweepRewoundCapsules(const FVector& End) const;
+
+	/** Damages the target and returns the projectile to its pool */
+	void HitTarget(AActor* Target);
+
+private:
+	/** Owned by a UBMProjectilePoolSubsystem */
+	bool bPooled;
+
+	/** Spawned locally by the owning client ahead of the server */
+	bool bPredicted;
+
+	/** Counted in BMEntityCounts::LiveProjectiles */
+	bool bCountedLive;
+
+	/** Flight is tested against rewound capsules */
+	bool bLagCompensated;
+
+	/** How far behind the server the shooter saw the world when firing, in seconds */
+	float RewindSeconds;
+
+	/** Start of the movement not tested against rewound capsules yet */
+	FVector LagCompensationStart;
+};
@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMHealZoneComponent.h"
+
+#include "BMGameplayServerCharacter.h"
+#include "BMHealZoneSubsystem.h"
+#include "Engine/World.h"
+
+UBMHealZoneComponent::UBMHealZoneComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	InitSphereRadius(200.0f);
+	SetCollisionProfileName(TEXT("Trigger"));
+	SetGenerateOverlapEvents(true);
+
+	HealPerSecond = 10.0f;
+}
+
+void UBMHealZoneComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (GetOwnerRole() != ROLE_Authority)
+	{
+		return;
+	}
+
+	OnComponentBeginOverlap.AddDynamic(this, &UBMHealZoneComponent::OnZoneBeginOverlap);
+	OnComponentEndOverlap.AddDynamic(this, &UBMHealZoneComponent::OnZoneEndOverlap);
+
+	// Characters that spawned inside never get a begin overlap
+	TArray<AActor*> OverlappingActors;
+	GetOverlappingActors(OverlappingActors, ABMGameplayServerCharacter::StaticClass());
+	for (AActor* Actor : OverlappingActors)
+	{
+		AddOccupant(Actor);
+	}
+}
+
+void UBMHealZoneComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Occupants.Reset();
+
+	UBMHealZoneSubsystem* HealZones = GetWorld()->GetSubsystem<UBMHealZoneSubsystem>();
+	if (HealZones)
+	{
+		HealZones->SetZoneAwake(this, false);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UBMHealZoneComponent::OnZoneBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult)
+{
+	AddOccupant(OtherActor);
+}
+
+void UBMHealZoneComponent::OnZoneEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex)
+{
+	// The character may still touch the zone with another of its components
+	ABMGameplayServerCharacter* Character = Cast<ABMGameplayServerCharacter>(OtherActor);
+	if (Character && !IsOverlappingActor(Character))
+	{
+		Occupants.Remove(Character);
+	}
+}
+
+void UBMHealZoneComponent::AddOccupant(AActor* Actor)
+{
+	ABMGameplayServerCharacter* Character = Cast<ABMGameplayServerCharacter>(Actor);
+	if (Character == nullptr || Occupants.Contains(Character))
+	{
+		return;
+	}
+
+	Occupants.Add(Character);
+
+	UBMHealZoneSubsystem* HealZones = GetWorld()->GetSubsystem<UBMHealZoneSubsystem>();
+	if (HealZones)
+	{
+		HealZones->SetZoneAwake(this, true);
+	}
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SphereComponent.h"
+#include "BMHealZoneComponent.generated.h"
+
+/**
+ * Heals characters standing inside its sphere. Occupants are tracked from overlap events and
+ * healed by the world's UBMHealZoneSubsystem in one pass for all zones, so a zone costs nothing
+ * while empty. Server only, clients just see the overlap volume.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class BMGAMEPLAYSERVER_API UBMHealZoneComponent : public USphereComponent
+{
+	GENERATED_BODY()
+
+public:
+	UBMHealZoneComponent();
+
+	/** Health per second given to each occupant */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Healing", meta = (ClampMin = "0.0"))
+	float HealPerSecond;
+
+	/** Characters inside the zone, stale entries are dropped by the heal pass */
+	TArray<TWeakObjectPtr<class ABMGameplayServerCharacter>> Occupants;
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	UFUNCTION()
+	void OnZoneBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
+
+	UFUNCTION()
+	void OnZoneEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex);
+
+	/** Wakes the zone in the subsystem when it gets its first occupant */
+	void AddOccupant(AActor* Actor);
+};
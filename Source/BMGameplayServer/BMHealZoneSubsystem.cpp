@@ -0,0 +1,125 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMHealZoneSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerCharacter.h"
+#include "BMHealthComponent.h"
+#include "BMHealZoneComponent.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Heal zone pass"), STAT_BMHealZonePass, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Awake heal zones"), STAT_BMAwakeHealZones, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Heal zone heals"), STAT_BMHealZoneHeals, STATGROUP_BMGameplay);
+
+UBMHealZoneSubsystem::UBMHealZoneSubsystem()
+{
+	HealInterval = 0.5f;
+	TimeSinceHeal = 0.0f;
+}
+
+bool UBMHealZoneSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+void UBMHealZoneSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_BMAwakeHealZones, AwakeZones.Num());
+	AwakeZones.Reset();
+
+	Super::Deinitialize();
+}
+
+bool UBMHealZoneSubsystem::IsTickable() const
+{
+	return AwakeZones.Num() > 0;
+}
+
+ETickableTickType UBMHealZoneSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMHealZoneSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMHealZoneSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UBMHealZoneSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UBMHealZoneSubsystem::Tick(float DeltaTime)
+{
+	// Fixed rate, a long frame heals once for the whole interval instead of catching up pass by pass
+	TimeSinceHeal += DeltaTime;
+	if (TimeSinceHeal >= HealInterval)
+	{
+		HealOccupants(HealInterval);
+		TimeSinceHeal = FMath::Fmod(TimeSinceHeal, FMath::Max(HealInterval, KINDA_SMALL_NUMBER));
+	}
+}
+
+void UBMHealZoneSubsystem::SetZoneAwake(UBMHealZoneComponent* Zone, bool bAwake)
+{
+	if (bAwake)
+	{
+		// The first zone to wake starts a full interval, nobody gets healed the frame they walk in
+		if (AwakeZones.Num() == 0)
+		{
+			TimeSinceHeal = 0.0f;
+		}
+		if (!AwakeZones.Contains(Zone))
+		{
+			AwakeZones.Add(Zone);
+			INC_DWORD_STAT(STAT_BMAwakeHealZones);
+		}
+	}
+	else if (AwakeZones.Remove(Zone) > 0)
+	{
+		DEC_DWORD_STAT(STAT_BMAwakeHealZones);
+	}
+}
+
+void UBMHealZoneSubsystem::HealOccupants(float Seconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMHealZonePass);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, HealZonePass);
+
+	for (int32 ZoneIndex = AwakeZones.Num() - 1; ZoneIndex >= 0; --ZoneIndex)
+	{
+		UBMHealZoneComponent* Zone = AwakeZones[ZoneIndex].Get();
+		if (Zone)
+		{
+			const float HealAmount = Zone->HealPerSecond * Seconds;
+			for (int32 Index = Zone->Occupants.Num() - 1; Index >= 0; --Index)
+			{
+				ABMGameplayServerCharacter* Character = Zone->Occupants[Index].Get();
+				if (Character == nullptr)
+				{
+					Zone->Occupants.RemoveAtSwap(Index);
+					continue;
+				}
+
+				// Full health reads the regeneration curve, no health change and no net wake up
+				UBMHealthComponent* Health = Character->HealthComp;
+				if (Health && !Character->IsDead() && !Health->IsMaxHealth())
+				{
+					Health->BMHeal(HealAmount);
+					INC_DWORD_STAT(STAT_BMHealZoneHeals);
+				}
+			}
+		}
+
+		// Empty zones sleep until their next begin overlap
+		if (Zone == nullptr || Zone->Occupants.Num() == 0)
+		{
+			AwakeZones.RemoveAtSwap(ZoneIndex);
+			DEC_DWORD_STAT(STAT_BMAwakeHealZones);
+		}
+	}
+}
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMHealZoneSubsystem.generated.h"
+
+class UBMHealZoneComponent;
+
+/**
+ * Heals the occupants of every awake UBMHealZoneComponent in one pass every HealInterval
+ * seconds. Characters already at max health or dead are skipped. A zone falls asleep when a pass
+ * finds it empty and wakes on its next occupant, the subsystem only ticks while a zone is awake.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMHealZoneSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UBMHealZoneSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Adds a zone to the heal pass or takes it out. Server only */
+	void SetZoneAwake(UBMHealZoneComponent* Zone, bool bAwake);
+
+	/** Heals the occupants of all awake zones for Seconds worth of healing */
+	void HealOccupants(float Seconds);
+
+protected:
+	/** Seconds between heal passes */
+	UPROPERTY(config)
+	float HealInterval;
+
+private:
+	TArray<TWeakObjectPtr<UBMHealZoneComponent>> AwakeZones;
+
+	/** Seconds since the last heal pass */
+	float TimeSinceHeal;
+};
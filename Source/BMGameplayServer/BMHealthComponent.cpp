@@ -5,6 +5,12 @@
 #include "Net/UnrealNetwork.h"
 #include "Engine/Engine.h"
 #include "BMGameplayServerCharacter.h"
+#include "BMGameplayServer.h"
+#include "GameFramework/GameStateBase.h"
+#include "TimerManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Set current health"), STAT_BMSetCurrentHealth, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Health changes"), STAT_BMHealthChanges, STATGROUP_BMGameplay);
 
 // Sets default values for this component's properties
 UBMHealthComponent::UBMHealthComponent()
@@ -16,6 +22,16 @@ UBMHealthComponent::UBMHealthComponent()
     //Initialize the player's Health
     MaxHealth = 100.0f;
     CurrentHealth = MaxHealth;
+
+    RegenDelay = 5.0f;
+    RegenRate = 5.0f;
+    RegenWidgetInterval = 0.1f;
+
+    NetSleepDelay = 2.0f;
+    NetRefreshInterval = 10.0f;
+    bNetAsleep = false;
+    bCountedAwake = false;
+    bCountedDormant = false;
 }
 
 // Called when the game starts
@@ -27,6 +43,22 @@ void UBMHealthComponent::BeginPlay()
     if (Owner != nullptr) {
         Owner->OnTakeAnyDamage.AddDynamic(this, &UBMHealthComponent::HandleTakeAnyDamage);
     }
+
+    if (GetOwnerRole() == ROLE_Authority && GetIsReplicated())
+    {
+        WakeNet();
+    }
+}
+
+void UBMHealthComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    GetWorld()->GetTimerManager().ClearTimer(RegenWidgetTimerHandle);
+    GetWorld()->GetTimerManager().ClearTimer(NetSleepTimerHandle);
+
+    BMEntityCounts::Track(BMEntityCounts::AwakeHealthComponents, bCountedAwake, false);
+    BMEntityCounts::Track(BMEntityCounts::DormantHealthComponents, bCountedDormant, false);
+
+    Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -41,11 +73,13 @@ void UBMHealthComponent::GetLifetimeReplicatedProps(TArray <FLifetimeProperty>&
     Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
     //Replicate current health.
-    DOREPLIFETIME(UBMHealthComponent, CurrentHealth);
+    BM_DOREPLIFETIME_PUSH(UBMHealthComponent, ReplicatedHealth, COND_None);
+    BM_DOREPLIFETIME_PUSH(UBMHealthComponent, RegenStartTime, COND_None);
 }
 
 void UBMHealthComponent::OnRep_CurrentHealth()
 {
+    CurrentHealth = ReplicatedHealth.GetFraction() * MaxHealth;
     OnHealthUpdate();
 }
 
@@ -68,13 +102,48 @@ void UBMHealthComponent::OnHealthUpdate()
     // Functions that occur on all machines. 
     // Any special functionality that should occur as a result of damage or death should be placed here.
     OnHealthChangeDelegate.Broadcast(); // Broadcast in case owner wants to execute functionality
+
+    RefreshRegenWidgetTimer();
 }
 
 void UBMHealthComponent::SetCurrentHealth(float healthValue)
 {
     if (GetOwnerRole() == ROLE_Authority)   // We only modify health on the server
     {
+        SCOPE_CYCLE_COUNTER(STAT_BMSetCurrentHealth);
+        CSV_SCOPED_TIMING_STAT(BMGameplay, SetCurrentHealth);
+        INC_DWORD_STAT(STAT_BMHealthChanges);
+
+        // Regeneration so far becomes real health here, it is never stepped
+        const float previousHealth = GetCurrentHealth();
+        const FBMNetTime previousRegenStart = RegenStartTime;
+        const float now = GetServerWorldTime();
+
         CurrentHealth = FMath::Clamp(healthValue, 0.f, MaxHealth);  // Impossible to set CurrentHealth to an invalid value
+        ReplicatedHealth.SetFraction(MaxHealth > 0.f ? CurrentHealth / MaxHealth : 0.f);
+        BM_MARK_PROPERTY_DIRTY(UBMHealthComponent, ReplicatedHealth, this);
+
+        // Damage restarts the delay, healing keeps a running regeneration going from the new value
+        if (CurrentHealth <= 0.f || CurrentHealth >= MaxHealth || RegenRate <= 0.f)
+        {
+            RegenStartTime = FBMNetTime();
+        }
+        else if (CurrentHealth < previousHealth || !RegenStartTime.IsSet())
+        {
+            RegenStartTime.SetSeconds(now + RegenDelay);
+        }
+        else if (RegenStartTime.GetSeconds() < now)
+        {
+            RegenStartTime.SetSeconds(now);
+        }
+        BM_MARK_PROPERTY_DIRTY(UBMHealthComponent, RegenStartTime, this);
+
+        // Back into replication right away, the quiet period starts over
+        if (GetIsReplicated() && (CurrentHealth != previousHealth || !(RegenStartTime == previousRegenStart)))
+        {
+            WakeNet();
+        }
+
         OnHealthUpdate();   // This is necessary because the server will not recieve the RepNotify
     }
 }
@@ -86,12 +155,12 @@ void UBMHealthComponent::HandleTakeAnyDamage(AActor* DamagedActor, float Damage,
 
 void UBMHealthComponent::BMHeal(float healAmount)
 {
-    SetCurrentHealth(CurrentHealth + healAmount);
+    SetCurrentHealth(GetCurrentHealth() + healAmount);
 }
 
 void UBMHealthComponent::BMDamage(float damageAmount)
 {
-    SetCurrentHealth(CurrentHealth - damageAmount);
+    SetCurrentHealth(GetCurrentHealth() - damageAmount);
 }
 
 void UBMHealthComponent::RestoreHealth()
@@ -99,8 +168,88 @@ void UBMHealthComponent::RestoreHealth()
     SetCurrentHealth(MaxHealth);
 }
 
+float UBMHealthComponent::GetCurrentHealth() const
+{
+    // Evaluated on demand, nothing ticks or replicates while health regenerates
+    if (!RegenStartTime.IsSet() || CurrentHealth <= 0.f)
+    {
+        return CurrentHealth;
+    }
+
+    const float regenSeconds = GetServerWorldTime() - RegenStartTime.GetSeconds();
+    return regenSeconds > 0.f ? FMath::Min(CurrentHealth + RegenRate * regenSeconds, MaxHealth) : CurrentHealth;
+}
+
 float UBMHealthComponent::GetNormalizedHealth() const
 {
-    return CurrentHealth / MaxHealth;
+    return GetCurrentHealth() / MaxHealth;
 }
 
+float UBMHealthComponent::GetServerWorldTime() const
+{
+    const AGameStateBase* gameState = GetWorld()->GetGameState();
+    return gameState ? gameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+}
+
+void UBMHealthComponent::RefreshRegenWidgetTimer()
+{
+    // Only the local player's widget follows regeneration, anything else reads GetCurrentHealth when it needs it
+    const APawn* pawnOwner = Cast<APawn>(GetOwner());
+    FTimerManager& timerManager = GetWorld()->GetTimerManager();
+    if (RegenStartTime.IsSet() && CurrentHealth > 0.f && !IsMaxHealth() && pawnOwner && pawnOwner->IsLocallyControlled())
+    {
+        const float firstDelay = FMath::Max(RegenStartTime.GetSeconds() - GetServerWorldTime(), RegenWidgetInterval);
+        timerManager.SetTimer(RegenWidgetTimerHandle, this, &UBMHealthComponent::OnRegenWidgetTimer, RegenWidgetInterval, true, firstDelay);
+    }
+    else
+    {
+        timerManager.ClearTimer(RegenWidgetTimerHandle);
+    }
+}
+
+void UBMHealthComponent::OnRegenWidgetTimer()
+{
+    OnHealthChangeDelegate.Broadcast();
+
+    if (IsMaxHealth())
+    {
+        GetWorld()->GetTimerManager().ClearTimer(RegenWidgetTimerHandle);
+    GetWorld()->GetTimerManager().ClearTimer(NetSleepTimerHandle);
+    }
+}
+
+bool UBMHealthComponent::ConsiderForReplication(bool bNetInitial) const
+{
+    // A channel that just opened still needs the current health once
+    return !bNetAsleep || bNetInitial;
+}
+
+void UBMHealthComponent::SetNetAsleep(bool bAsleep)
+{
+    bNetAsleep = bAsleep;
+    BMEntityCounts::Track(BMEntityCounts::AwakeHealthComponents, bCountedAwake, !bAsleep);
+    BMEntityCounts::Track(BMEntityCounts::DormantHealthComponents, bCountedDormant, bAsleep);
+}
+
+void UBMHealthComponent::WakeNet()
+{
+    SetNetAsleep(false);
+    GetWorld()->GetTimerManager().SetTimer(NetSleepTimerHandle, this, &UBMHealthComponent::OnNetSleepTimer, FMath::Max(NetSleepDelay, KINDA_SMALL_NUMBER), false);
+}
+
+void UBMHealthComponent::OnNetSleepTimer()
+{
+    // Asleep health wakes up for a while now and then, a client whose copy is stale after a lost
+    // or delayed update catches up then instead of at the next change
+    if (bNetAsleep)
+    {
+        WakeNet();
+        return;
+    }
+
+    SetNetAsleep(true);
+    if (NetRefreshInterval > 0.f)
+    {
+        GetWorld()->GetTimerManager().SetTimer(NetSleepTimerHandle, this, &UBMHealthComponent::OnNetSleepTimer, NetRefreshInterval, false);
+    }
+}
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "BMNetQuantization.h"
 #include "BMHealthComponent.generated.h"
 
 
@@ -33,6 +34,8 @@ protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	/** RepNotify for changes made to current health */
 	UFUNCTION()
 	void OnRep_CurrentHealth();
@@ -44,14 +47,73 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Health")
 	float MaxHealth;
 
-	/** The player's current health */
-	UPROPERTY(ReplicatedUsing = OnRep_CurrentHealth)
+	/**
+	 * The player's health as of the last change. Regeneration adds to it from RegenStartTime on,
+	 * GetCurrentHealth evaluates that. Exact on the server, clients rebuild it from ReplicatedHealth
+	 */
+	UPROPERTY()
 	float CurrentHealth;
 
+	/** CurrentHealth sent to clients as a quantized fraction of max health */
+	UPROPERTY(ReplicatedUsing = OnRep_CurrentHealth)
+	FBMNetHealth ReplicatedHealth;
+
+	/** Seconds after taking damage before health regenerates */
+	UPROPERTY(EditDefaultsOnly, Category = "Health", meta = (ClampMin = "0.0"))
+	float RegenDelay;
+
+	/** Health regenerated per second out of combat, 0 turns regeneration off */
+	UPROPERTY(EditDefaultsOnly, Category = "Health", meta = (ClampMin = "0.0"))
+	float RegenRate;
+
+	/** Seconds between health widget updates of the local player while regenerating */
+	UPROPERTY(EditDefaultsOnly, Category = "Health", meta = (ClampMin = "0.01"))
+	float RegenWidgetInterval;
+
+	/** Server world time health starts regenerating from CurrentHealth, unset when it doesn't */
+	UPROPERTY(ReplicatedUsing = OnRep_CurrentHealth)
+	FBMNetTime RegenStartTime;
+
+	FTimerHandle RegenWidgetTimerHandle;
+
+	/** Runs the widget timer while the local player regenerates */
+	void RefreshRegenWidgetTimer();
+
+	void OnRegenWidgetTimer();
+
+	/** World time synchronized with the server */
+	float GetServerWorldTime() const;
+
 	/** Setter for Current Health. Clamps the value between 0 and MaxHealth and calls OnHealthUpdate. Should only be called on the server.*/
 	UFUNCTION(BlueprintCallable, Category = "Health")
 	void SetCurrentHealth(float healthValue);
 
+	/** Seconds without a health change before the server stops replicating health, until it changes again */
+	UPROPERTY(EditDefaultsOnly, Category = "Health", meta = (ClampMin = "0.0"))
+	float NetSleepDelay;
+
+	/** Seconds between resends while asleep, so a change a lossy or saturated client missed still reaches it. 0 never resends */
+	UPROPERTY(EditDefaultsOnly, Category = "Health", meta = (ClampMin = "0.0"))
+	float NetRefreshInterval;
+
+	/** Health is left out of replication */
+	bool bNetAsleep;
+
+	/** Puts health to sleep after NetSleepDelay, and wakes it for a refresh every NetRefreshInterval */
+	FTimerHandle NetSleepTimerHandle;
+
+	/** Counted in BMEntityCounts::AwakeHealthComponents and DormantHealthComponents */
+	bool bCountedAwake;
+	bool bCountedDormant;
+
+	/** Wakes health replication up, or puts it to sleep */
+	void SetNetAsleep(bool bAsleep);
+
+	/** Keeps health awake for NetSleepDelay from now */
+	void WakeNet();
+
+	void OnNetSleepTimer();
+
 	/** Damage handler for owner actor */
 	UFUNCTION(BlueprintCallable)
 	void HandleTakeAnyDamage(AActor* DamagedActor, float Damage, const class UDamageType* DamageType, class AController* InstigatedBy, AActor* DamageCauser);
@@ -64,13 +126,16 @@ public:
 	UFUNCTION(BlueprintPure, Category = "Health")
 	FORCEINLINE float GetMaxHealth() const { return MaxHealth; }
 
-	/** Getter for Current Health.*/
+	/** Getter for Current Health, including regeneration up to now.*/
 	UFUNCTION(BlueprintPure, Category = "Health")
-	FORCEINLINE float GetCurrentHealth() const { return CurrentHealth; }
+	float GetCurrentHealth() const;
 
 	/** Player has max health */
 	UFUNCTION(BlueprintPure, Category = "Health")
-	FORCEINLINE bool IsMaxHealth() const { return CurrentHealth == MaxHealth; }
+	FORCEINLINE bool IsMaxHealth() const { return GetCurrentHealth() == MaxHealth; }
+
+	/** Health is regenerating or waiting out RegenDelay to */
+	FORCEINLINE bool IsRegenerating() const { return RegenStartTime.IsSet(); }
 
 	/** Getter for Current Health.*/
 	UFUNCTION(BlueprintPure, Category = "Health")
@@ -88,4 +153,15 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Health")
 	void RestoreHealth();
 
+	/**
+	 * Whether the owner should replicate this component in this net update. Health falls asleep
+	 * after NetSleepDelay seconds without a change and is skipped until the next change or refresh,
+	 * except for channels that just opened. Server only, called from the owner's ReplicateSubobjects
+	 * once per channel, so it only reads the state the sleep timer keeps.
+	 */
+	bool ConsiderForReplication(bool bNetInitial) const;
+
+	/** Health is left out of replication */
+	FORCEINLINE bool IsNetAsleep() const { return bNetAsleep; }
+
 };
@@ -0,0 +1,292 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMLagCompensationSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerCharacter.h"
+#include "Components/CapsuleComponent.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Lag compensation record"), STAT_BMLagCompensationRecord, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Lag compensation query"), STAT_BMLagCompensationQuery, STATGROUP_BMGameplay);
+
+static TAutoConsoleVariable<int32> CVarLagCompensationDebug(
+	TEXT("bm.LagCompensation.Debug"),
+	0,
+	TEXT("Draw rewound capsules (green) next to current capsules (red) for every lag compensated hit, and log the hit.\n")
+	TEXT("A dedicated server has no viewport, read the log there."),
+	ECVF_Cheat);
+
+void FBMCapsuleHistory::Record(const FVector& Location, float HalfHeight, float Time)
+{
+	Head = (Head + 1) % Capacity;
+	Num = FMath::Min(Num + 1, Capacity);
+
+	FBMCapsuleSample& Sample = Samples[Head];
+	Sample.Location = Location;
+	Sample.HalfHeight = HalfHeight;
+	Sample.Time = Time;
+}
+
+bool FBMCapsuleHistory::Sample(float Time, FBMCapsuleSample& OutSample) const
+{
+	if (Num == 0)
+	{
+		return false;
+	}
+
+	// Walk from newest to oldest until we pass Time
+	const FBMCapsuleSample* Newer = &Samples[Head];
+	if (Time >= Newer->Time)
+	{
+		OutSample = *Newer;
+		return true;
+	}
+
+	for (int32 i = 1; i < Num; ++i)
+	{
+		const FBMCapsuleSample* Older = &Samples[(Head - i + Capacity) % Capacity];
+		if (Older->Time <= Time)
+		{
+			const float Span = Newer->Time - Older->Time;
+			const float Alpha = Span > KINDA_SMALL_NUMBER ? (Time - Older->Time) / Span : 1.f;
+			OutSample.Location = FMath::Lerp(Older->Location, Newer->Location, Alpha);
+			OutSample.HalfHeight = FMath::Lerp(Older->HalfHeight, Newer->HalfHeight, Alpha);
+			OutSample.Time = Time;
+			return true;
+		}
+		Newer = Older;
+	}
+
+	// Older than our history, use the oldest sample
+	OutSample = *Newer;
+	return true;
+}
+
+UBMLagCompensationSubsystem::UBMLagCompensationSubsystem()
+{
+	bEnabled = true;
+	MaxRewindTime = 0.25f;
+	InterpolationDelay = 0.0f;
+}
+
+bool UBMLagCompensationSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+bool UBMLagCompensationSubsystem::IsTickable() const
+{
+	return bEnabled && Histories.Num() > 0;
+}
+
+ETickableTickType UBMLagCompensationSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMLagCompensationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMLagCompensationSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UBMLagCompensationSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+float UBMLagCompensationSubsystem::GetServerTime() const
+{
+	return GetWorld()->GetTimeSeconds();
+}
+
+void UBMLagCompensationSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMLagCompensationRecord);
+
+	// Ticks after all actors moved, so this is the state clients will be sent this frame
+	const float Now = GetServerTime();
+	for (FBMCapsuleHistory& History : Histories)
+	{
+		const ABMGameplayServerCharacter* Character = History.Character.Get();
+		if (Character)
+		{
+			const UCapsuleComponent* Capsule = Character->GetCapsuleComponent();
+			History.Record(Capsule->GetComponentLocation(), Capsule->GetScaledCapsuleHalfHeight(), Now);
+		}
+	}
+}
+
+void UBMLagCompensationSubsystem::RegisterCharacter(ABMGameplayServerCharacter* Character)
+{
+	if (Character == nullptr || HistoryIndices.Contains(Character) || GetWorld()->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	const int32 Index = Histories.AddDefaulted();
+	Histories[Index].Character = Character;
+	Histories[Index].Key = Character;
+	Histories[Index].Radius = Character->GetCapsuleComponent()->GetScaledCapsuleRadius();
+	HistoryIndices.Add(Character, Index);
+}
+
+void UBMLagCompensationSubsystem::UnregisterCharacter(ABMGameplayServerCharacter* Character)
+{
+	int32 Index = INDEX_NONE;
+	if (!HistoryIndices.RemoveAndCopyValue(Character, Index))
+	{
+		return;
+	}
+
+	Histories.RemoveAtSwap(Index, 1, false);
+	if (Histories.IsValidIndex(Index))
+	{
+		HistoryIndices.Add(Histories[Index].Key, Index);
+	}
+}
+
+void UBMLagCompensationSubsystem::ResetHistory(ABMGameplayServerCharacter* Character)
+{
+	const int32* Index = HistoryIndices.Find(Character);
+	if (Index == nullptr)
+	{
+		return;
+	}
+
+	// Restart from the current capsule so the character can be hit before the next record
+	FBMCapsuleHistory& History = Histories[*Index];
+	History.Head = INDEX_NONE;
+	History.Num = 0;
+
+	const UCapsuleComponent* Capsule = Character->GetCapsuleComponent();
+	History.Record(Capsule->GetComponentLocation(), Capsule->GetScaledCapsuleHalfHeight(), GetServerTime());
+}
+
+float UBMLagCompensationSubsystem::GetViewTime(const AController* Shooter) const
+{
+	const float Now = GetServerTime();
+	if (!bEnabled || Shooter == nullptr || Shooter->PlayerState == nullptr)
+	{
+		return Now;
+	}
+
+	// The shot reached us half a round trip late and was aimed at a world half a round trip old
+	const float Rewind = Shooter->PlayerState->ExactPing * 0.001f + InterpolationDelay;
+	return Now - FMath::Clamp(Rewind, 0.f, MaxRewindTime);
+}
+
+bool UBMLagCompensationSubsystem::GetCapsuleAtTime(const ABMGameplayServerCharacter* Character, float Time, FBMCapsuleSample& OutSample, float& OutRadius) const
+{
+	const int32* Index = HistoryIndices.Find(Character);
+	if (Index == nullptr)
+	{
+		return false;
+	}
+
+	const FBMCapsuleHistory& History = Histories[*Index];
+	OutRadius = History.Radius;
+	return History.Sample(Time, OutSample);
+}
+
+void UBMLagCompensationSubsystem::GetCharactersInSphere(const FVector& Center, float Radius, float Time, const AActor* IgnoreActor, TArray<ABMGameplayServerCharacter*>& OutCharacters) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMLagCompensationQuery);
+
+	for (const FBMCapsuleHistory& History : Histories)
+	{
+		ABMGameplayServerCharacter* Character = History.Character.Get();
+		FBMCapsuleSample Rewound;
+		if (Character == nullptr || Character == IgnoreActor || !History.Sample(Time, Rewound))
+		{
+			continue;
+		}
+
+		// Distance to the capsule's inner segment
+		const FVector Axis(0.f, 0.f, FMath::Max(Rewound.HalfHeight - History.Radius, 0.f));
+		const FVector Closest = FMath::ClosestPointOnSegment(Center, Rewound.Location - Axis, Rewound.Location + Axis);
+		if (FVector::DistSquared(Center, Closest) <= FMath::Square(Radius + History.Radius))
+		{
+			OutCharacters.Add(Character);
+			DrawDebugRewind(History, Rewound);
+		}
+	}
+}
+
+ABMGameplayServerCharacter* UBMLagCompensationSubsystem::SweepSphere(const FVector& Start, const FVector& End, float Radius, float Time, const AActor* IgnoreActor, FVector& OutHitLocation) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMLagCompensationQuery);
+
+	ABMGameplayServerCharacter* BestCharacter = nullptr;
+	float BestDistSquared = MAX_flt;
+
+	for (const FBMCapsuleHistory& History : Histories)
+	{
+		ABMGameplayServerCharacter* Character = History.Character.Get();
+		FBMCapsuleSample Rewound;
+		if (Character == nullptr || Character == IgnoreActor || !History.Sample(Time, Rewound))
+		{
+			continue;
+		}
+
+		const FVector Axis(0.f, 0.f, FMath::Max(Rewound.HalfHeight - History.Radius, 0.f));
+		FVector OnPath, OnCapsule;
+		FMath::SegmentDistToSegmentSafe(Start, End, Rewound.Location - Axis, Rewound.Location + Axis, OnPath, OnCapsule);
+
+		if (FVector::DistSquared(OnPath, OnCapsule) <= FMath::Square(Radius + History.Radius))
+		{
+			// Keep the one closest to the start of the move
+			const float DistSquared = FVector::DistSquared(Start, OnPath);
+			if (DistSquared < BestDistSquared)
+			{
+				BestDistSquared = DistSquared;
+				BestCharacter = Character;
+				OutHitLocation = OnPath;
+			}
+			DrawDebugRewind(History, Rewound);
+		}
+	}
+
+	return BestCharacter;
+}
+
+void UBMLagCompensationSubsystem::GetRegisteredCharacters(TArray<AActor*>& OutCharacters) const
+{
+	for (const FBMCapsuleHistory& History : Histories)
+	{
+		if (History.Character.IsValid())
+		{
+			OutCharacters.Add(History.Character.Get());
+		}
+	}
+}
+
+void UBMLagCompensationSubsystem::DrawDebugRewind(const FBMCapsuleHistory& History, const FBMCapsuleSample& Rewound) const
+{
+	if (CVarLagCompensationDebug.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+
+	const ABMGameplayServerCharacter* Character = History.Character.Get();
+	if (Character)
+	{
+		const UCapsuleComponent* Capsule = Character->GetCapsuleComponent();
+		UE_LOG(LogBMGameplay, Display, TEXT("Lag compensation: hit %s rewound %.0f ms, %.1f cm from its current capsule"),
+			*Character->GetName(), (GetServerTime() - Rewound.Time) * 1000.0f, FVector::Dist(Capsule->GetComponentLocation(), Rewound.Location));
+
+#if ENABLE_DRAW_DEBUG
+		DrawDebugCapsule(GetWorld(), Capsule->GetComponentLocation(), Capsule->GetScaledCapsuleHalfHeight(), History.Radius, FQuat::Identity, FColor::Red, false, 2.0f);
+#endif
+	}
+
+#if ENABLE_DRAW_DEBUG
+	DrawDebugCapsule(GetWorld(), Rewound.Location, Rewound.HalfHeight, History.Radius, FQuat::Identity, FColor::Green, false, 2.0f);
+#endif
+}
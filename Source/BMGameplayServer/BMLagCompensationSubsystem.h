@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMLagCompensationSubsystem.generated.h"
+
+class ABMGameplayServerCharacter;
+
+/** Capsule of a character at one point in server time */
+struct FBMCapsuleSample
+{
+	FVector Location;
+	float HalfHeight;
+	float Time;
+};
+
+/** Fixed size ring buffer of capsule samples for one character */
+struct FBMCapsuleHistory
+{
+	static constexpr int32 Capacity = 64;
+
+	TWeakObjectPtr<ABMGameplayServerCharacter> Character;
+
+	/** Lookup key, stays valid for bookkeeping after the character is gone */
+	const ABMGameplayServerCharacter* Key = nullptr;
+
+	/** Capsule radius does not change at runtime */
+	float Radius = 0.f;
+
+	/** Index of the newest sample */
+	int32 Head = INDEX_NONE;
+
+	/** Valid samples, up to Capacity */
+	int32 Num = 0;
+
+	FBMCapsuleSample Samples[Capacity];
+
+	void Record(const FVector& Location, float HalfHeight, float Time);
+
+	/** Capsule interpolated at Time, clamped to the recorded range */
+	bool Sample(float Time, FBMCapsuleSample& OutSample) const;
+};
+
+/**
+ * Server side lag compensation. Records the capsule of every ABMGameplayServerCharacter once per
+ * frame into a fixed size ring buffer and lets hit validation rewind targets to the time the
+ * shooter saw them, capped by MaxRewindTime.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMLagCompensationSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UBMLagCompensationSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Starts recording the character. Server only */
+	void RegisterCharacter(ABMGameplayServerCharacter* Character);
+
+	/** Stops recording the character */
+	void UnregisterCharacter(ABMGameplayServerCharacter* Character);
+
+	/** Drops the recorded history of a teleported character so rewinds never interpolate across the teleport */
+	void ResetHistory(ABMGameplayServerCharacter* Character);
+
+	/** Server time at which the shooter saw the world, from its ping and capped by MaxRewindTime */
+	float GetViewTime(const AController* Shooter) const;
+
+	/** Capsule of the character at Time */
+	bool GetCapsuleAtTime(const ABMGameplayServerCharacter* Character, float Time, FBMCapsuleSample& OutSample, float& OutRadius) const;
+
+	/** Characters whose rewound capsule overlaps the sphere */
+	void GetCharactersInSphere(const FVector& Center, float Radius, float Time, const AActor* IgnoreActor, TArray<ABMGameplayServerCharacter*>& OutCharacters) const;
+
+	/** First character whose rewound capsule is touched by a sphere moving from Start to End */
+	ABMGameplayServerCharacter* SweepSphere(const FVector& Start, const FVector& End, float Radius, float Time, const AActor* IgnoreActor, FVector& OutHitLocation) const;
+
+	/** Every recorded character, so physics queries can ignore their current capsules */
+	void GetRegisteredCharacters(TArray<AActor*>& OutCharacters) const;
+
+	/** Lag compensation is enabled */
+	FORCEINLINE bool IsEnabled() const { return bEnabled; }
+
+protected:
+	/** Rewind targets when validating hits */
+	UPROPERTY(config)
+	bool bEnabled;
+
+	/** Never rewind further than this, in seconds */
+	UPROPERTY(config)
+	float MaxRewindTime;
+
+	/** Added to the shooter's round trip time to account for client interpolation, in seconds */
+	UPROPERTY(config)
+	float InterpolationDelay;
+
+private:
+	/** Draws current and rewound capsules and logs the hit when bm.LagCompensation.Debug is set */
+	void DrawDebugRewind(const FBMCapsuleHistory& History, const FBMCapsuleSample& Rewound) const;
+
+	float GetServerTime() const;
+
+	TArray<FBMCapsuleHistory> Histories;
+	TMap<const ABMGameplayServerCharacter*, int32> HistoryIndices;
+};
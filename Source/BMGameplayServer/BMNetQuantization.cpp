@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMNetQuantization.h"
+
+void FBMNetHealth::SetFraction(float Fraction)
+{
+	const float Clamped = FMath::Clamp(Fraction, 0.0f, 1.0f);
+	const int32 Lowest = Clamped > 0.0f ? 1 : 0;
+	const int32 Highest = Clamped < 1.0f ? BMNetQuantization::HealthSteps - 1 : BMNetQuantization::HealthSteps;
+	Quantized = (uint16)FMath::Clamp(FMath::RoundToInt(Clamped * BMNetQuantization::HealthSteps), Lowest, Highest);
+}
+
+bool FBMNetHealth::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 Value = Quantized;
+	Ar.SerializeInt(Value, BMNetQuantization::HealthSteps + 1);
+	Quantized = (uint16)FMath::Min(Value, BMNetQuantization::HealthSteps);
+
+	bOutSuccess = true;
+	return true;
+}
+
+void FBMNetTime::SetSeconds(float Seconds)
+{
+	Units = (uint32)FMath::RoundToInt(FMath::Max(Seconds, 0.0f) * BMNetQuantization::TimeUnitsPerSecond);
+}
+
+bool FBMNetTime::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar.SerializeIntPacked(Units);
+
+	bOutSuccess = true;
+	return true;
+}
@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BMNetQuantization.generated.h"
+
+/** Wire precision of quantized gameplay values. Client and server have to be built with the same numbers */
+namespace BMNetQuantization
+{
+	/** Bits of replicated health, as a fraction of max health. 10 bits keep steps under 0.1 at 100 max health */
+	constexpr uint32 HealthBits = 10;
+
+	constexpr uint32 HealthSteps = (1u << HealthBits) - 1;
+
+	/** Replicated world times are rounded to 1 / TimeUnitsPerSecond seconds */
+	constexpr uint32 TimeUnitsPerSecond = 20;
+
+	/** Largest difference between a fraction and its replicated value */
+	constexpr float MaxHealthFractionError = 1.0f / HealthSteps;
+
+	/** Largest difference between a time and its replicated value, in seconds */
+	constexpr float MaxTimeError = 0.5f / TimeUnitsPerSecond;
+}
+
+/**
+ * Health as a fraction of max health, sent in HealthBits bits instead of a 32 bit float. Health
+ * above 0 never rounds to 0 and health below max never rounds to max, so clients agree with the
+ * server on death and IsMaxHealth.
+ */
+USTRUCT()
+struct BMGAMEPLAYSERVER_API FBMNetHealth
+{
+	GENERATED_BODY()
+
+	void SetFraction(float Fraction);
+
+	FORCEINLINE float GetFraction() const { return (float)Quantized / BMNetQuantization::HealthSteps; }
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	FORCEINLINE bool operator==(const FBMNetHealth& Other) const { return Quantized == Other.Quantized; }
+
+private:
+	UPROPERTY()
+	uint16 Quantized = BMNetQuantization::HealthSteps;
+};
+
+template<>
+struct TStructOpsTypeTraits<FBMNetHealth> : public TStructOpsTypeTraitsBase2<FBMNetHealth>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+/** Server world time in 1 / TimeUnitsPerSecond units, int packed on the wire. 0 is unset */
+USTRUCT()
+struct BMGAMEPLAYSERVER_API FBMNetTime
+{
+	GENERATED_BODY()
+
+	void SetSeconds(float Seconds);
+
+	FORCEINLINE float GetSeconds() const { return (float)Units / BMNetQuantization::TimeUnitsPerSecond; }
+
+	FORCEINLINE bool IsSet() const { return Units != 0; }
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	FORCEINLINE bool operator==(const FBMNetTime& Other) const { return Units == Other.Units; }
+
+private:
+	UPROPERTY()
+	uint32 Units = 0;
+};
+
+template<>
+struct TStructOpsTypeTraits<FBMNetTime> : public TStructOpsTypeTraitsBase2<FBMNetTime>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
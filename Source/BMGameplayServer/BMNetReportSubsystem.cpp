@@ -0,0 +1,394 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMNetReportSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+#include "Net/DataReplication.h"
+#include "Net/UnrealNetwork.h"
+
+DECLARE_CYCLE_STAT(TEXT("Net report diff"), STAT_BMNetReportDiff, STATGROUP_BMGameplay);
+
+bool UBMNetSizePackageMap::SerializeObject(FArchive& Ar, UClass* InClass, UObject*& Obj, FNetworkGUID* OutNetGUID)
+{
+	uint32 NetGUID = 0;
+	Ar << NetGUID;
+	return true;
+}
+
+FBMNetSnapshot::~FBMNetSnapshot()
+{
+	if (Data)
+	{
+		for (const FBMNetPropertyLayout& PropertyLayout : Layout->Properties)
+		{
+			PropertyLayout.Property->DestroyValue(Data + PropertyLayout.SnapshotOffset);
+		}
+		FMemory::Free(Data);
+	}
+}
+
+UBMNetReportSubsystem::UBMNetReportSubsystem()
+{
+	bEnabled = false;
+	LogInterval = 60.0f;
+	MaxReportLines = 40;
+	SizePackageMap = nullptr;
+	WindowStartTime = 0.0;
+	LastLogTime = 0.0;
+}
+
+bool UBMNetReportSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+void UBMNetReportSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	SizePackageMap = NewObject<UBMNetSizePackageMap>(this);
+	WindowStartTime = FPlatformTime::Seconds();
+	LastLogTime = WindowStartTime;
+}
+
+void UBMNetReportSubsystem::Deinitialize()
+{
+	// Snapshots point into the class layouts
+	Snapshots.Empty();
+	ClassLayouts.Empty();
+	Stats.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UBMNetReportSubsystem::IsTickable() const
+{
+	const UWorld* World = GetWorld();
+	return bEnabled && LogInterval > 0.0f && World && World->GetNetMode() != NM_Client && World->GetNetMode() != NM_Standalone;
+}
+
+ETickableTickType UBMNetReportSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMNetReportSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMNetReportSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UBMNetReportSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UBMNetReportSubsystem::Tick(float DeltaTime)
+{
+	if (FPlatformTime::Seconds() - LastLogTime >= LogInterval)
+	{
+		LogReport();
+	}
+}
+
+void UBMNetReportSubsystem::NotePreReplication(const AActor* Actor)
+{
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	if (!bEnabled || NetDriver == nullptr)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_BMNetReportDiff);
+
+	// Subobjects replicate through the actor's channel
+	const int32 NumChannels = CountOpenChannels(NetDriver, Actor);
+	NoteObject(Actor, NumChannels);
+	for (const UActorComponent* Component : Actor->GetReplicatedComponents())
+	{
+		if (Component && Component->GetIsReplicated())
+		{
+			NoteObject(Component, NumChannels);
+		}
+	}
+}
+
+void UBMNetReportSubsystem::NoteRemoteFunction(const AActor* Actor, const UFunction* Function, const void* Parameters, const UObject* SubObject)
+{
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	if (!bEnabled || NetDriver == nullptr || Function->HasAnyFunctionFlags(FUNC_NetServer))
+	{
+		return;
+	}
+
+	const int32 Receivers = Function->HasAnyFunctionFlags(FUNC_NetMulticast) ? CountOpenChannels(NetDriver, Actor) : 1;
+
+	int64 Bits = 0;
+	for (TFieldIterator<UProperty> It(Function); It && (It->PropertyFlags & (CPF_Parm | CPF_ReturnParm)) == CPF_Parm; ++It)
+	{
+		Bits += EstimateBits(*It, It->ContainerPtrToValuePtr<void>(Parameters));
+	}
+
+	FBMNetStat& Stat = FindOrAddStat(SubObject ? SubObject->GetClass() : Actor->GetClass(), Function, true);
+	Stat.Sends += Receivers;
+	Stat.Bits += Bits * Receivers;
+}
+
+void UBMNetReportSubsystem::NoteObject(const UObject* Object, int32 NumChannels)
+{
+	const UClass* Class = Object->GetClass();
+	const FBMNetClassLayout& Layout = GetClassLayout(Class);
+	if (Layout.Properties.Num() == 0)
+	{
+		return;
+	}
+
+	// First update: compare with the defaults, like the initial bunch does
+	FBMNetSnapshot& Snapshot = Snapshots.FindOrAdd(Object);
+	const bool bInitial = Snapshot.Data == nullptr;
+	if (bInitial)
+	{
+		const UObject* Defaults = Class->GetDefaultObject();
+		Snapshot.Layout = &Layout;
+		Snapshot.Data = (uint8*)FMemory::Malloc(FMath::Max(Layout.SnapshotSize, 1), Layout.SnapshotAlignment);
+		for (const FBMNetPropertyLayout& PropertyLayout : Layout.Properties)
+		{
+			PropertyLayout.Property->InitializeValue(Snapshot.Data + PropertyLayout.SnapshotOffset);
+			PropertyLayout.Property->CopyCompleteValue(Snapshot.Data + PropertyLayout.SnapshotOffset, PropertyLayout.Property->ContainerPtrToValuePtr<void>(Defaults));
+		}
+	}
+
+	for (const FBMNetPropertyLayout& PropertyLayout : Layout.Properties)
+	{
+		const UProperty* Property = PropertyLayout.Property;
+		uint8* Previous = Snapshot.Data + PropertyLayout.SnapshotOffset;
+		const uint8* Current = Property->ContainerPtrToValuePtr<uint8>(Object);
+
+		bool bChanged = false;
+		for (int32 Index = 0; Index < Property->ArrayDim && !bChanged; ++Index)
+		{
+			bChanged = !Property->Identical(Previous + Index * Property->ElementSize, Current + Index * Property->ElementSize);
+		}
+		if (!bChanged)
+		{
+			continue;
+		}
+
+		int32 Receivers = NumChannels;
+		switch (PropertyLayout.Condition)
+		{
+		case COND_OwnerOnly:
+		case COND_AutonomousOnly:
+		case COND_ReplayOrOwner:
+			Receivers = FMath::Min(NumChannels, 1);
+			break;
+		case COND_SkipOwner:
+		case COND_SimulatedOnly:
+		case COND_SimulatedOnlyNoReplay:
+			Receivers = FMath::Max(NumChannels - 1, 0);
+			break;
+		case COND_InitialOnly:
+		case COND_InitialOrOwner:
+			Receivers = bInitial ? NumChannels : 0;
+			break;
+		default:
+			break;
+		}
+
+		if (Receivers > 0)
+		{
+			FBMNetStat& Stat = FindOrAddStat(Class, Property, false);
+			Stat.Sends += Receivers;
+			Stat.Bits += EstimateBits(Property, Current) * Receivers;
+		}
+
+		Property->CopyCompleteValue(Previous, Current);
+	}
+}
+
+const FBMNetClassLayout& UBMNetReportSubsystem::GetClassLayout(const UClass* Class)
+{
+	if (const TUniquePtr<FBMNetClassLayout>* Existing = ClassLayouts.Find(Class))
+	{
+		return **Existing;
+	}
+
+	FBMNetClassLayout& Layout = *ClassLayouts.Add(Class, MakeUnique<FBMNetClassLayout>());
+
+	const_cast<UClass*>(Class)->SetUpRuntimeReplicationData();
+	TArray<FLifetimeProperty> LifetimeProperties;
+	Class->GetDefaultObject()->GetLifetimeReplicatedProps(LifetimeProperties);
+
+	for (const FLifetimeProperty& LifetimeProperty : LifetimeProperties)
+	{
+		// Static arrays have a rep index per element, they are compared as a whole from the first
+		if (LifetimeProperty.Condition == COND_Never || !Class->ClassReps.IsValidIndex(LifetimeProperty.RepIndex) || Class->ClassReps[LifetimeProperty.RepIndex].Index != 0)
+		{
+			continue;
+		}
+
+		UProperty* Property = Class->ClassReps[LifetimeProperty.RepIndex].Property;
+		const int32 Alignment = Property->GetMinAlignment();
+
+		FBMNetPropertyLayout& PropertyLayout = Layout.Properties.AddDefaulted_GetRef();
+		PropertyLayout.Property = Property;
+		PropertyLayout.SnapshotOffset = Align(Layout.SnapshotSize, Alignment);
+		PropertyLayout.Condition = LifetimeProperty.Condition;
+
+		Layout.SnapshotSize = PropertyLayout.SnapshotOffset + Property->GetSize();
+		Layout.SnapshotAlignment = FMath::Max(Layout.SnapshotAlignment, Alignment);
+	}
+
+	return Layout;
+}
+
+int32 UBMNetReportSubsystem::CountOpenChannels(const UNetDriver* NetDriver, const AActor* Actor) const
+{
+	int32 NumChannels = 0;
+	for (UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		if (Connection && Connection->FindActorChannelRef(const_cast<AActor*>(Actor)))
+		{
+			NumChannels++;
+		}
+	}
+	return NumChannels;
+}
+
+FBMNetStat& UBMNetReportSubsystem::FindOrAddStat(const UClass* Class, const UField* Field, bool bRPC)
+{
+	const TPair<const UClass*, const UField*> Key(Class, Field);
+	FBMNetStat* Stat = Stats.Find(Key);
+	if (Stat == nullptr)
+	{
+		Stat = &Stats.Add(Key);
+		Stat->ClassName = Class->GetFName();
+		Stat->FieldName = Field->GetFName();
+		Stat->bRPC = bRPC;
+	}
+	return *Stat;
+}
+
+int64 UBMNetReportSubsystem::EstimateBits(const UProperty* Property, const void* Value) const
+{
+	int64 Bits = 0;
+	for (int32 Index = 0; Index < Property->ArrayDim; ++Index)
+	{
+		const uint8* Element = (const uint8*)Value + Index * Property->ElementSize;
+
+		// Arrays and structs without NetSerialize are replicated field by field
+		const UStructProperty* StructProperty = Cast<UStructProperty>(Property);
+		const UArrayProperty* ArrayProperty = Cast<UArrayProperty>(Property);
+		if (StructProperty && !(StructProperty->Struct->StructFlags & STRUCT_NetSerializeNative))
+		{
+			for (TFieldIterator<UProperty> It(StructProperty->Struct); It; ++It)
+			{
+				if (!(It->PropertyFlags & CPF_RepSkip))
+				{
+					Bits += EstimateBits(*It, It->ContainerPtrToValuePtr<void>(Element));
+				}
+			}
+		}
+		else if (ArrayProperty)
+		{
+			FScriptArrayHelper ArrayHelper(ArrayProperty, Element);
+			Bits += 16;
+			for (int32 ArrayIndex = 0; ArrayIndex < ArrayHelper.Num(); ++ArrayIndex)
+			{
+				Bits += EstimateBits(ArrayProperty->Inner, ArrayHelper.GetRawPtr(ArrayIndex));
+			}
+		}
+		else
+		{
+			FNetBitWriter Writer(SizePackageMap, 1024);
+			Property->NetSerializeItem(Writer, SizePackageMap, const_cast<uint8*>(Element));
+			Bits += Writer.GetNumBits();
+		}
+	}
+	return Bits;
+}
+
+void UBMNetReportSubsystem::LogReport()
+{
+	const double Now = FPlatformTime::Seconds();
+	const double Seconds = FMath::Max(Now - WindowStartTime, 0.001);
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+
+	TArray<const FBMNetStat*> Sorted;
+	TMap<FName, int64> ClassBits;
+	int64 TotalBits = 0;
+	for (const TPair<TPair<const UClass*, const UField*>, FBMNetStat>& Pair : Stats)
+	{
+		Sorted.Add(&Pair.Value);
+		ClassBits.FindOrAdd(Pair.Value.ClassName) += Pair.Value.Bits;
+		TotalBits += Pair.Value.Bits;
+	}
+	Sorted.Sort([](const FBMNetStat& A, const FBMNetStat& B) { return A.Bits > B.Bits; });
+	ClassBits.ValueSort([](int64 A, int64 B) { return A > B; });
+
+	UE_LOG(LogBMGameplay, Display, TEXT("Net report over %.1f s, %d connections, ~%.1f KB/s of property and RPC payload:"),
+		Seconds, NetDriver ? NetDriver->ClientConnections.Num() : 0, TotalBits / 8.0 / 1024.0 / Seconds);
+
+	for (const TPair<FName, int64>& Pair : ClassBits)
+	{
+		UE_LOG(LogBMGameplay, Display, TEXT("  %-40s %10.1f B/s"), *Pair.Key.ToString(), Pair.Value / 8.0 / Seconds);
+	}
+
+	for (int32 Index = 0; Index < Sorted.Num() && Index < MaxReportLines; ++Index)
+	{
+		const FBMNetStat& Stat = *Sorted[Index];
+		UE_LOG(LogBMGameplay, Display, TEXT("  %-56s %-4s %8.1f sends/s %10.1f B/s"),
+			*FString::Printf(TEXT("%s.%s"), *Stat.ClassName.ToString(), *Stat.FieldName.ToString()),
+			Stat.bRPC ? TEXT("rpc") : TEXT("prop"), Stat.Sends / Seconds, Stat.Bits / 8.0 / Seconds);
+	}
+
+	// Drop objects that were destroyed since the last report
+	for (auto It = Snapshots.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	Stats.Reset();
+	WindowStartTime = Now;
+	LastLogTime = Now;
+}
+
+/**
+ * bm.NetReport [0|1]
+ * Logs estimated bytes and sends per second of every tracked replicated property and RPC since the
+ * last report. 1 or 0 turns tracking on or off instead.
+ */
+static FAutoConsoleCommandWithWorldAndArgs BMNetReportCommand(
+	TEXT("bm.NetReport"),
+	TEXT("Logs replicated property and RPC bandwidth per class since the last report. Usage: bm.NetReport [0|1] to turn tracking off or on"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UBMNetReportSubsystem* NetReport = World ? World->GetSubsystem<UBMNetReportSubsystem>() : nullptr;
+		if (NetReport == nullptr)
+		{
+			return;
+		}
+
+		if (Args.Num() > 0)
+		{
+			NetReport->SetEnabled(FCString::ToBool(*Args[0]));
+			UE_LOG(LogBMGameplay, Display, TEXT("Net report tracking %s"), NetReport->IsEnabled() ? TEXT("on") : TEXT("off"));
+		}
+		else if (NetReport->IsEnabled())
+		{
+			NetReport->LogReport();
+		}
+		else
+		{
+			UE_LOG(LogBMGameplay, Display, TEXT("Net report tracking is off, turn it on with bm.NetReport 1"));
+		}
+	}));
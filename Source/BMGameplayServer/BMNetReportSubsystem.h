@@ -0,0 +1,145 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/CoreNet.h"
+#include "BMNetReportSubsystem.generated.h"
+
+class UNetDriver;
+
+/** Lets the report net serialize values without a connection, object references count as a 32 bit net GUID */
+UCLASS(transient)
+class UBMNetSizePackageMap : public UPackageMap
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool SerializeObject(FArchive& Ar, UClass* InClass, UObject*& Obj, FNetworkGUID* OutNetGUID = nullptr) override;
+};
+
+/** A replicated property of a class and the connections it is sent to */
+struct FBMNetPropertyLayout
+{
+	UProperty* Property;
+
+	/** Offset of the first element in the snapshot buffer */
+	int32 SnapshotOffset;
+
+	/** Lifetime condition, decides how many connections receive a change */
+	ELifetimeCondition Condition;
+};
+
+/** Replicated properties of a class and where their values live in a snapshot */
+struct FBMNetClassLayout
+{
+	TArray<FBMNetPropertyLayout> Properties;
+	int32 SnapshotSize = 0;
+	int32 SnapshotAlignment = 1;
+};
+
+/** Replicated values of one object as of its last net update */
+struct FBMNetSnapshot
+{
+	const FBMNetClassLayout* Layout = nullptr;
+	uint8* Data = nullptr;
+
+	FBMNetSnapshot() = default;
+	FBMNetSnapshot(const FBMNetSnapshot&) = delete;
+	FBMNetSnapshot& operator=(const FBMNetSnapshot&) = delete;
+	~FBMNetSnapshot();
+};
+
+/** Sends and estimated size of one property or RPC */
+struct FBMNetStat
+{
+	FName ClassName;
+	FName FieldName;
+	bool bRPC = false;
+	int64 Sends = 0;
+	int64 Bits = 0;
+};
+
+/**
+ * Estimates which replicated properties and RPCs use the server's bandwidth. On every net update of
+ * a tracked actor its replicated properties, and those of its replicated components, are compared
+ * with the previous update. Each change counts as a send to every connection with the actor's
+ * channel open (one for owner only properties), sized by net serializing the new value. RPCs are
+ * counted as the replication graph sends them. bm.NetReport logs the result per class, property and
+ * RPC in bytes and sends per second, and the server logs it every LogInterval seconds.
+ *
+ * The sizes leave out packet, bunch and property handle overhead and changes sent to channels
+ * opening later, so use them to rank costs, not as exact totals. Server only.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMNetReportSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UBMNetReportSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Counts the properties of the actor and its replicated components that changed since its last net update */
+	void NotePreReplication(const AActor* Actor);
+
+	/** Counts an RPC the server is sending */
+	void NoteRemoteFunction(const AActor* Actor, const UFunction* Function, const void* Parameters, const UObject* SubObject);
+
+	/** Logs bytes and sends per second since the last report and starts a new window */
+	void LogReport();
+
+	FORCEINLINE bool IsEnabled() const { return bEnabled; }
+
+	FORCEINLINE void SetEnabled(bool bInEnabled) { bEnabled = bInEnabled; }
+
+protected:
+	/** Track replication, off by default since every net update of a tracked actor is diffed */
+	UPROPERTY(config)
+	bool bEnabled;
+
+	/** Seconds between automatic reports, 0 only reports on bm.NetReport */
+	UPROPERTY(config)
+	float LogInterval;
+
+	/** Properties and RPCs listed per report, most expensive first */
+	UPROPERTY(config)
+	int32 MaxReportLines;
+
+private:
+	void NoteObject(const UObject* Object, int32 NumChannels);
+
+	const FBMNetClassLayout& GetClassLayout(const UClass* Class);
+
+	/** Client connections with a channel open for the actor */
+	int32 CountOpenChannels(const UNetDriver* NetDriver, const AActor* Actor) const;
+
+	FBMNetStat& FindOrAddStat(const UClass* Class, const UField* Field, bool bRPC);
+
+	/** Net serialized size of a property value, in bits */
+	int64 EstimateBits(const UProperty* Property, const void* Value) const;
+
+	UPROPERTY()
+	UBMNetSizePackageMap* SizePackageMap;
+
+	/** Boxed so snapshots can keep pointers to them */
+	TMap<const UClass*, TUniquePtr<FBMNetClassLayout>> ClassLayouts;
+	TMap<TWeakObjectPtr<const UObject>, FBMNetSnapshot> Snapshots;
+	TMap<TPair<const UClass*, const UField*>, FBMNetStat> Stats;
+
+	double WindowStartTime;
+	double LastLogTime;
+};
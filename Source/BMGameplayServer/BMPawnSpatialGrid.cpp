@@ -0,0 +1,367 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMPawnSpatialGrid.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerCharacter.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/KismetSystemLibrary.h"
+
+DECLARE_CYCLE_STAT(TEXT("Spatial grid rebuild"), STAT_BMSpatialGridRebuild, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Spatial grid query"), STAT_BMSpatialGridQuery, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Spatial grid queries"), STAT_BMSpatialGridQueries, STATGROUP_BMGameplay);
+
+namespace BMPawnSpatialGrid
+{
+	/** Floats per vector register */
+	static const int32 LaneCount = 4;
+
+	/** Lanes of a vector load that belong to the current cell */
+	static FORCEINLINE int32 GetLaneMask(int32 Remaining)
+	{
+		return (1 << FMath::Min(Remaining, LaneCount)) - 1;
+	}
+}
+
+UBMPawnSpatialGrid::UBMPawnSpatialGrid()
+{
+	CellSize = 500.0f;
+	MaxCapsuleRadius = 0.0f;
+}
+
+bool UBMPawnSpatialGrid::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+bool UBMPawnSpatialGrid::IsTickable() const
+{
+	return Characters.Num() > 0 || SortedCharacters.Num() > 0;
+}
+
+ETickableTickType UBMPawnSpatialGrid::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMPawnSpatialGrid::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMPawnSpatialGrid, STATGROUP_Tickables);
+}
+
+UWorld* UBMPawnSpatialGrid::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UBMPawnSpatialGrid::Tick(float DeltaTime)
+{
+	// Ticks after all actors moved, queries during the next frame see this frame's positions
+	Rebuild();
+}
+
+void UBMPawnSpatialGrid::RegisterCharacter(ABMGameplayServerCharacter* Character)
+{
+	if (Character)
+	{
+		Characters.AddUnique(Character);
+	}
+}
+
+void UBMPawnSpatialGrid::UnregisterCharacter(ABMGameplayServerCharacter* Character)
+{
+	Characters.RemoveSingleSwap(Character, false);
+
+	// Stop returning it before the next rebuild
+	const int32 SortedIndex = SortedCharacters.Find(Character);
+	if (SortedIndex != INDEX_NONE)
+	{
+		SortedCharacters[SortedIndex] = nullptr;
+	}
+}
+
+FIntPoint UBMPawnSpatialGrid::GetCell(float X, float Y) const
+{
+	return FIntPoint(FMath::FloorToInt(X / CellSize), FMath::FloorToInt(Y / CellSize));
+}
+
+void UBMPawnSpatialGrid::Rebuild()
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMSpatialGridRebuild);
+
+	struct FEntry
+	{
+		FIntPoint Cell;
+		ABMGameplayServerCharacter* Character;
+		FVector Location;
+		float Radius;
+		float SegmentHalfHeight;
+	};
+
+	TArray<FEntry> Entries;
+	Entries.Reserve(Characters.Num());
+	MaxCapsuleRadius = 0.0f;
+
+	for (int32 i = Characters.Num() - 1; i >= 0; --i)
+	{
+		ABMGameplayServerCharacter* Character = Characters[i].Get();
+		if (Character == nullptr)
+		{
+			Characters.RemoveAtSwap(i, 1, false);
+			continue;
+		}
+
+		const UCapsuleComponent* Capsule = Character->GetCapsuleComponent();
+		FEntry& Entry = Entries.AddDefaulted_GetRef();
+		Entry.Character = Character;
+		Entry.Location = Capsule->GetComponentLocation();
+		Entry.Cell = GetCell(Entry.Location.X, Entry.Location.Y);
+		Entry.Radius = Capsule->GetScaledCapsuleRadius();
+		Entry.SegmentHalfHeight = FMath::Max(Capsule->GetScaledCapsuleHalfHeight() - Entry.Radius, 0.0f);
+		MaxCapsuleRadius = FMath::Max(MaxCapsuleRadius, Entry.Radius);
+	}
+
+	// Characters of a cell end up next to each other
+	Entries.Sort([](const FEntry& A, const FEntry& B)
+	{
+		return A.Cell.Y != B.Cell.Y ? A.Cell.Y < B.Cell.Y : A.Cell.X < B.Cell.X;
+	});
+
+	const int32 PaddedNum = Entries.Num() + BMPawnSpatialGrid::LaneCount - 1;
+	SortedCharacters.Reset(Entries.Num());
+	PositionsX.Reset(PaddedNum);
+	PositionsY.Reset(PaddedNum);
+	PositionsZ.Reset(PaddedNum);
+	Radii.Reset(PaddedNum);
+	SegmentHalfHeights.Reset(PaddedNum);
+	Cells.Reset();
+
+	for (int32 i = 0; i < Entries.Num(); ++i)
+	{
+		const FEntry& Entry = Entries[i];
+		SortedCharacters.Add(Entry.Character);
+		PositionsX.Add(Entry.Location.X);
+		PositionsY.Add(Entry.Location.Y);
+		PositionsZ.Add(Entry.Location.Z);
+		Radii.Add(Entry.Radius);
+		SegmentHalfHeights.Add(Entry.SegmentHalfHeight);
+
+		FBMSpatialGridCell& Cell = Cells.FindOrAdd(Entry.Cell);
+		if (Cell.Num == 0)
+		{
+			Cell.Start = i;
+		}
+		Cell.Num++;
+	}
+
+	// Lanes past the last character are masked out, the padding only keeps the loads in bounds
+	PositionsX.AddZeroed(PaddedNum - Entries.Num());
+	PositionsY.AddZeroed(PaddedNum - Entries.Num());
+	PositionsZ.AddZeroed(PaddedNum - Entries.Num());
+	Radii.AddZeroed(PaddedNum - Entries.Num());
+	SegmentHalfHeights.AddZeroed(PaddedNum - Entries.Num());
+}
+
+template<typename VisitorType>
+void UBMPawnSpatialGrid::ForEachInSphere(const FVector& Center, float Radius, VisitorType&& Visitor) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMSpatialGridQuery);
+	INC_DWORD_STAT(STAT_BMSpatialGridQueries);
+
+	const VectorRegister CenterX = VectorSetFloat1(Center.X);
+	const VectorRegister CenterY = VectorSetFloat1(Center.Y);
+	const VectorRegister CenterZ = VectorSetFloat1(Center.Z);
+	const VectorRegister QueryRadius = VectorSetFloat1(Radius);
+	const VectorRegister Zero = VectorZero();
+
+	auto TestCell = [&](const FBMSpatialGridCell& Cell)
+	{
+		const int32 End = Cell.Start + Cell.Num;
+		for (int32 i = Cell.Start; i < End; i += BMPawnSpatialGrid::LaneCount)
+		{
+			const VectorRegister DeltaX = VectorSubtract(VectorLoad(PositionsX.GetData() + i), CenterX);
+			const VectorRegister DeltaY = VectorSubtract(VectorLoad(PositionsY.GetData() + i), CenterY);
+
+			// Vertical distance to the capsule's inner segment
+			const VectorRegister DeltaZ = VectorMax(VectorSubtract(VectorAbs(VectorSubtract(VectorLoad(PositionsZ.GetData() + i), CenterZ)),
+				VectorLoad(SegmentHalfHeights.GetData() + i)), Zero);
+
+			const VectorRegister DistSquared = VectorMultiplyAdd(DeltaX, DeltaX, VectorMultiplyAdd(DeltaY, DeltaY, VectorMultiply(DeltaZ, DeltaZ)));
+			const VectorRegister Reach = VectorAdd(QueryRadius, VectorLoad(Radii.GetData() + i));
+
+			int32 Mask = VectorMaskBits(VectorCompareGE(VectorMultiply(Reach, Reach), DistSquared)) & BMPawnSpatialGrid::GetLaneMask(End - i);
+			while (Mask)
+			{
+				Visitor(i + FMath::CountTrailingZeros(Mask));
+				Mask &= Mask - 1;
+			}
+		}
+	};
+
+	const float Reach = Radius + MaxCapsuleRadius;
+	const FIntPoint MinCell = GetCell(Center.X - Reach, Center.Y - Reach);
+	const FIntPoint MaxCell = GetCell(Center.X + Reach, Center.Y + Reach);
+	const int64 NumQueryCells = int64(MaxCell.X - MinCell.X + 1) * int64(MaxCell.Y - MinCell.Y + 1);
+
+	// Huge spheres touch more cells than are occupied, walk the occupied ones instead
+	if (NumQueryCells > Cells.Num())
+	{
+		for (const TPair<FIntPoint, FBMSpatialGridCell>& Pair : Cells)
+		{
+			TestCell(Pair.Value);
+		}
+		return;
+	}
+
+	for (int32 CellY = MinCell.Y; CellY <= MaxCell.Y; ++CellY)
+	{
+		for (int32 CellX = MinCell.X; CellX <= MaxCell.X; ++CellX)
+		{
+			const FBMSpatialGridCell* Cell = Cells.Find(FIntPoint(CellX, CellY));
+			if (Cell)
+			{
+				TestCell(*Cell);
+			}
+		}
+	}
+}
+
+void UBMPawnSpatialGrid::GetCharactersInSphere(const FVector& Center, float Radius, const AActor* IgnoreActor, TArray<ABMGameplayServerCharacter*>& OutCharacters) const
+{
+	ForEachInSphere(Center, Radius, [&](int32 Index)
+	{
+		ABMGameplayServerCharacter* Character = SortedCharacters[Index];
+		if (Character && Character != IgnoreActor)
+		{
+			OutCharacters.Add(Character);
+		}
+	});
+}
+
+void UBMPawnSpatialGrid::GetCharacterHitsInSphere(const FVector& Center, float Radius, const AActor* IgnoreActor, TArray<FBMSpatialGridHit>& OutHits) const
+{
+	ForEachInSphere(Center, Radius, [&](int32 Index)
+	{
+		ABMGameplayServerCharacter* Character = SortedCharacters[Index];
+		if (Character && Character != IgnoreActor)
+		{
+			// Same capsule distance as the vector test, only for the few that passed it
+			const float DeltaZ = FMath::Max(FMath::Abs(PositionsZ[Index] - Center.Z) - SegmentHalfHeights[Index], 0.f);
+			const FVector Delta(PositionsX[Index] - Center.X, PositionsY[Index] - Center.Y, DeltaZ);
+
+			FBMSpatialGridHit& Hit = OutHits.AddDefaulted_GetRef();
+			Hit.Character = Character;
+			Hit.Distance = Delta.Size() - Radii[Index];
+		}
+	});
+}
+
+int32 UBMPawnSpatialGrid::CountCharactersInSphere(const FVector& Center, float Radius, const AActor* IgnoreActor) const
+{
+	int32 Count = 0;
+	ForEachInSphere(Center, Radius, [&](int32 Index)
+	{
+		const ABMGameplayServerCharacter* Character = SortedCharacters[Index];
+		if (Character && Character != IgnoreActor)
+		{
+			Count++;
+		}
+	});
+	return Count;
+}
+
+void UBMPawnSpatialGrid::GetCharacterLocations(const AActor* IgnoreActor, TArray<FVector>& OutLocations) const
+{
+	for (int32 i = 0; i < SortedCharacters.Num(); ++i)
+	{
+		if (SortedCharacters[i] && SortedCharacters[i] != IgnoreActor)
+		{
+			OutLocations.Add(FVector(PositionsX[i], PositionsY[i], PositionsZ[i]));
+		}
+	}
+}
+
+/**
+ * bm.SpatialGrid.Benchmark [Queries]
+ * Spawns 16, 64 and 256 characters around the origin and times the same sphere queries through
+ * the spatial grid and through a physics overlap, logging both.
+ */
+static FAutoConsoleCommandWithWorldAndArgs BMSpatialGridBenchmarkCommand(
+	TEXT("bm.SpatialGrid.Benchmark"),
+	TEXT("Compares spatial grid sphere queries against physics overlaps at 16, 64 and 256 pawns. Usage: bm.SpatialGrid.Benchmark [Queries]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UBMPawnSpatialGrid* Grid = World ? World->GetSubsystem<UBMPawnSpatialGrid>() : nullptr;
+		if (Grid == nullptr)
+		{
+			return;
+		}
+
+		const int32 NumQueries = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000;
+		const float ArenaExtent = 5000.0f;
+		const float QueryRadius = 500.0f;
+		const int32 PawnCounts[] = { 16, 64, 256 };
+
+		FRandomStream Random(0x424d);
+		TArray<FVector> QueryCenters;
+		for (int32 i = 0; i < NumQueries; ++i)
+		{
+			QueryCenters.Add(FVector(Random.FRandRange(-ArenaExtent, ArenaExtent), Random.FRandRange(-ArenaExtent, ArenaExtent), 100.0f));
+		}
+
+		TArray<TEnumAsByte<EObjectTypeQuery>> TraceObjectTypes;
+		TraceObjectTypes.Add(UEngineTypes::ConvertToObjectType(ECollisionChannel::ECC_Pawn));
+
+		for (const int32 NumPawns : PawnCounts)
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+			TArray<ABMGameplayServerCharacter*> Spawned;
+			for (int32 i = 0; i < NumPawns; ++i)
+			{
+				const FVector Location(Random.FRandRange(-ArenaExtent, ArenaExtent), Random.FRandRange(-ArenaExtent, ArenaExtent), 100.0f);
+				ABMGameplayServerCharacter* Character = World->SpawnActor<ABMGameplayServerCharacter>(ABMGameplayServerCharacter::StaticClass(), Location, FRotator::ZeroRotator, SpawnParams);
+				if (Character)
+				{
+					Spawned.Add(Character);
+				}
+			}
+			Grid->Rebuild();
+
+			int32 GridHits = 0;
+			const double GridStart = FPlatformTime::Seconds();
+			for (const FVector& Center : QueryCenters)
+			{
+				GridHits += Grid->CountCharactersInSphere(Center, QueryRadius, nullptr);
+			}
+			const double GridSeconds = FPlatformTime::Seconds() - GridStart;
+
+			int32 PhysicsHits = 0;
+			TArray<AActor*> OutActors;
+			const TArray<AActor*> ActorsToIgnore;
+			const double PhysicsStart = FPlatformTime::Seconds();
+			for (const FVector& Center : QueryCenters)
+			{
+				OutActors.Reset();
+				UKismetSystemLibrary::SphereOverlapActors(World, Center, QueryRadius, TraceObjectTypes, nullptr, ActorsToIgnore, OutActors);
+				PhysicsHits += OutActors.Num();
+			}
+			const double PhysicsSeconds = FPlatformTime::Seconds() - PhysicsStart;
+
+			UE_LOG(LogBMGameplay, Display, TEXT("Spatial grid benchmark: %d pawns, %d queries. Grid %.3f ms (%d hits), physics %.3f ms (%d hits), %.1fx"),
+				Grid->GetNumCharacters(), NumQueries, GridSeconds * 1000.0, GridHits, PhysicsSeconds * 1000.0, PhysicsHits,
+				GridSeconds > 0.0 ? PhysicsSeconds / GridSeconds : 0.0);
+
+			for (ABMGameplayServerCharacter* Character : Spawned)
+			{
+				Character->Destroy();
+			}
+			Grid->Rebuild();
+		}
+	}),
+	ECVF_Cheat);
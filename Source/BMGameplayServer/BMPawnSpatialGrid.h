@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMPawnSpatialGrid.generated.h"
+
+class ABMGameplayServerCharacter;
+
+/** Run of pawns sharing a grid cell, indices into the sorted position arrays */
+struct FBMSpatialGridCell
+{
+	int32 Start = 0;
+	int32 Num = 0;
+};
+
+/** Character found by a sphere query and how far its capsule is from the query center */
+struct FBMSpatialGridHit
+{
+	ABMGameplayServerCharacter* Character = nullptr;
+
+	/** From the query center to the capsule's surface, negative when the center is inside the capsule */
+	float Distance = 0.f;
+};
+
+/**
+ * Uniform spatial hash of every ABMGameplayServerCharacter in the world. Rebuilt once per frame
+ * after actors tick, pawns are sorted by cell so each cell is a contiguous run of the position
+ * arrays and sphere queries test four capsules at a time. Used instead of physics overlaps for
+ * area of effect queries that only care about characters.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMPawnSpatialGrid : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UBMPawnSpatialGrid();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Starts tracking the character, from the next rebuild on */
+	void RegisterCharacter(ABMGameplayServerCharacter* Character);
+
+	/** Stops tracking the character */
+	void UnregisterCharacter(ABMGameplayServerCharacter* Character);
+
+	/** Rehashes every registered character at its current location */
+	void Rebuild();
+
+	/** Characters whose capsule overlaps the sphere, as of the last rebuild */
+	void GetCharactersInSphere(const FVector& Center, float Radius, const AActor* IgnoreActor, TArray<ABMGameplayServerCharacter*>& OutCharacters) const;
+
+	/** Characters whose capsule overlaps the sphere and their distances from the center, as of the last rebuild */
+	void GetCharacterHitsInSphere(const FVector& Center, float Radius, const AActor* IgnoreActor, TArray<FBMSpatialGridHit>& OutHits) const;
+
+	/** Number of characters whose capsule overlaps the sphere, as of the last rebuild */
+	int32 CountCharactersInSphere(const FVector& Center, float Radius, const AActor* IgnoreActor) const;
+
+	/** Capsule centers of every character hashed by the last rebuild */
+	void GetCharacterLocations(const AActor* IgnoreActor, TArray<FVector>& OutLocations) const;
+
+	/** Characters hashed by the last rebuild */
+	FORCEINLINE int32 GetNumCharacters() const { return SortedCharacters.Num(); }
+
+protected:
+	/** Edge of a grid cell in the XY plane, in cm */
+	UPROPERTY(config)
+	float CellSize;
+
+private:
+	/** Calls Visitor(Index) for every hashed capsule overlapping the sphere */
+	template<typename VisitorType>
+	void ForEachInSphere(const FVector& Center, float Radius, VisitorType&& Visitor) const;
+
+	FIntPoint GetCell(float X, float Y) const;
+
+	TArray<TWeakObjectPtr<ABMGameplayServerCharacter>> Characters;
+
+	/**
+	 * Per frame hash, sorted by cell. The position, radius and segment arrays are padded with
+	 * LaneCount - 1 zeroed entries so vector loads never read past the end; queries mask out the
+	 * padding lanes, so SortedCharacters itself is not padded.
+	 */
+	TArray<ABMGameplayServerCharacter*> SortedCharacters;
+	TArray<float> PositionsX;
+	TArray<float> PositionsY;
+	TArray<float> PositionsZ;
+	TArray<float> Radii;
+
+	/** Capsule half height minus radius, half length of the inner segment */
+	TArray<float> SegmentHalfHeights;
+
+	TMap<FIntPoint, FBMSpatialGridCell> Cells;
+
+	/** Largest capsule radius of the last rebuild, widens the cell range of queries */
+	float MaxCapsuleRadius;
+};
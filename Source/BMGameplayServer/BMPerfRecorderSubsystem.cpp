@@ -0,0 +1,246 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMPerfRecorderSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "BMPawnSpatialGrid.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace BMPerf
+{
+	/** Summary rows of every run, appended so builds can be compared side by side */
+	static const TCHAR* SummaryFileName = TEXT("BMPerfSummary.csv");
+
+	/** Value at Percent (0..1) of an ascending array */
+	static float Percentile(const TArray<float>& Sorted, float Percent)
+	{
+		if (Sorted.Num() == 0)
+		{
+			return 0.f;
+		}
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Percent * Sorted.Num()) - 1, 0, Sorted.Num() - 1);
+		return Sorted[Index];
+	}
+
+	static FString DescribePercentiles(TArray<float>& Values)
+	{
+		Values.Sort();
+		return FString::Printf(TEXT("%.3f,%.3f,%.3f,%.3f"), Percentile(Values, 0.5f), Percentile(Values, 0.95f), Percentile(Values, 0.99f), Values.Num() > 0 ? Values.Last() : 0.f);
+	}
+}
+
+UBMPerfRecorderSubsystem::UBMPerfRecorderSubsystem()
+{
+	WarmupSeconds = 5.0f;
+	bRecording = false;
+	bAutoStart = false;
+	AutoStopSeconds = 0.0f;
+	RecordStartTime = 0.0f;
+	TickStartCycles = 0;
+	PostActorTickCycles = 0;
+	CurrentDeltaSeconds = 0.0f;
+}
+
+bool UBMPerfRecorderSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+void UBMPerfRecorderSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UWorld* World = GetWorld();
+	TickDispatchHandle = World->OnTickDispatch().AddUObject(this, &UBMPerfRecorderSubsystem::OnTickDispatch);
+	PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &UBMPerfRecorderSubsystem::OnWorldPostActorTick);
+	PostTickFlushHandle = World->OnPostTickFlush().AddUObject(this, &UBMPerfRecorderSubsystem::OnPostTickFlush);
+
+	bAutoStart = FParse::Param(FCommandLine::Get(), TEXT("bmperf"));
+	FParse::Value(FCommandLine::Get(), TEXT("bmperfseconds="), AutoStopSeconds);
+}
+
+void UBMPerfRecorderSubsystem::Deinitialize()
+{
+	if (bRecording)
+	{
+		StopRecording();
+	}
+
+	UWorld* World = GetWorld();
+	World->OnTickDispatch().Remove(TickDispatchHandle);
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+	World->OnPostTickFlush().Remove(PostTickFlushHandle);
+
+	Super::Deinitialize();
+}
+
+void UBMPerfRecorderSubsystem::StartRecording(const FString& Label)
+{
+	bAutoStart = false;
+	bRecording = true;
+	RunLabel = Label.IsEmpty() ? FString(FApp::GetBuildVersion()) : Label;
+	RecordStartTime = GetWorld()->GetTimeSeconds();
+
+	// A minute at the default server tick rate
+	Frames.Reset();
+	Frames.Reserve(1800);
+
+	UE_LOG(LogBMGameplay, Display, TEXT("Perf recording '%s' started"), *RunLabel);
+}
+
+void UBMPerfRecorderSubsystem::StopRecording()
+{
+	if (!bRecording)
+	{
+		return;
+	}
+
+	bRecording = false;
+	WriteCSV();
+	Frames.Reset();
+}
+
+void UBMPerfRecorderSubsystem::OnTickDispatch(float DeltaSeconds)
+{
+	// First thing the world does each tick: receive packets
+	TickStartCycles = FPlatformTime::Cycles();
+	CurrentDeltaSeconds = DeltaSeconds;
+}
+
+void UBMPerfRecorderSubsystem::OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds)
+{
+	if (InWorld == GetWorld())
+	{
+		PostActorTickCycles = FPlatformTime::Cycles();
+	}
+}
+
+void UBMPerfRecorderSubsystem::OnPostTickFlush()
+{
+	UWorld* World = GetWorld();
+	const float Now = World->GetTimeSeconds();
+
+	if (bAutoStart && Now >= WarmupSeconds)
+	{
+		FString Label;
+		FParse::Value(FCommandLine::Get(), TEXT("bmperflabel="), Label);
+		StartRecording(Label);
+		return;
+	}
+
+	if (!bRecording || TickStartCycles == 0 || PostActorTickCycles == 0)
+	{
+		return;
+	}
+
+	// Replication and packet sends happen between the post actor tick and the end of the flush
+	const uint32 EndCycles = FPlatformTime::Cycles();
+	const UNetDriver* NetDriver = World->GetNetDriver();
+	const UBMPawnSpatialGrid* SpatialGrid = World->GetSubsystem<UBMPawnSpatialGrid>();
+
+	FBMPerfFrame& Frame = Frames.AddDefaulted_GetRef();
+	Frame.Time = Now;
+	Frame.FrameMs = CurrentDeltaSeconds * 1000.f;
+	Frame.WorldTickMs = FPlatformTime::ToMilliseconds(EndCycles - TickStartCycles);
+	Frame.GameMs = FPlatformTime::ToMilliseconds(PostActorTickCycles - TickStartCycles);
+	Frame.NetMs = FPlatformTime::ToMilliseconds(EndCycles - PostActorTickCycles);
+	Frame.OutBytesPerSecond = NetDriver ? NetDriver->OutBytesPerSecond : 0;
+	Frame.NumConnections = NetDriver ? NetDriver->ClientConnections.Num() : 0;
+	Frame.NumCharacters = SpatialGrid ? SpatialGrid->GetNumCharacters() : 0;
+
+	if (AutoStopSeconds > 0.f && Now - RecordStartTime >= AutoStopSeconds)
+	{
+		StopRecording();
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+void UBMPerfRecorderSubsystem::WriteCSV() const
+{
+	if (Frames.Num() == 0)
+	{
+		return;
+	}
+
+	const FString Directory = FPaths::ProfilingDir() / TEXT("BMPerf");
+	const FString RunName = FPaths::MakeValidFileName(RunLabel) + TEXT("_") + FDateTime::Now().ToString();
+
+	TArray<float> FrameMs, WorldTickMs, GameMs, NetMs;
+	double TotalOutBytes = 0.0;
+	int32 PeakOutBytesPerSecond = 0;
+	int32 MaxConnections = 0;
+	int32 MaxCharacters = 0;
+
+	FString FramesCSV = TEXT("Time,FrameMs,WorldTickMs,GameMs,NetMs,OutBytesPerSecond,Connections,Characters\n");
+	for (const FBMPerfFrame& Frame : Frames)
+	{
+		FramesCSV += FString::Printf(TEXT("%.3f,%.3f,%.3f,%.3f,%.3f,%d,%d,%d\n"),
+			Frame.Time, Frame.FrameMs, Frame.WorldTickMs, Frame.GameMs, Frame.NetMs, Frame.OutBytesPerSecond, Frame.NumConnections, Frame.NumCharacters);
+
+		FrameMs.Add(Frame.FrameMs);
+		WorldTickMs.Add(Frame.WorldTickMs);
+		GameMs.Add(Frame.GameMs);
+		NetMs.Add(Frame.NetMs);
+		TotalOutBytes += Frame.OutBytesPerSecond * Frame.FrameMs / 1000.0;
+		PeakOutBytesPerSecond = FMath::Max(PeakOutBytesPerSecond, Frame.OutBytesPerSecond);
+		MaxConnections = FMath::Max(MaxConnections, Frame.NumConnections);
+		MaxCharacters = FMath::Max(MaxCharacters, Frame.NumCharacters);
+	}
+
+	const FString FramesPath = Directory / RunName + TEXT("_frames.csv");
+	FFileHelper::SaveStringToFile(FramesCSV, *FramesPath);
+
+	const float Seconds = Frames.Last().Time - Frames[0].Time;
+	const FString SummaryPath = Directory / BMPerf::SummaryFileName;
+	FString SummaryCSV;
+	if (!IFileManager::Get().FileExists(*SummaryPath))
+	{
+		SummaryCSV = TEXT("Run,Map,Seconds,Frames,Connections,Characters,")
+			TEXT("FrameP50,FrameP95,FrameP99,FrameMax,")
+			TEXT("WorldTickP50,WorldTickP95,WorldTickP99,WorldTickMax,")
+			TEXT("GameP50,GameP95,GameP99,GameMax,")
+			TEXT("NetP50,NetP95,NetP99,NetMax,")
+			TEXT("AvgOutBytesPerSecond,PeakOutBytesPerSecond,TotalOutKB\n");
+	}
+	SummaryCSV += FString::Printf(TEXT("%s,%s,%.1f,%d,%d,%d,%s,%s,%s,%s,%.0f,%d,%.1f\n"),
+		*RunName, *GetWorld()->GetMapName(), Seconds, Frames.Num(), MaxConnections, MaxCharacters,
+		*BMPerf::DescribePercentiles(FrameMs), *BMPerf::DescribePercentiles(WorldTickMs),
+		*BMPerf::DescribePercentiles(GameMs), *BMPerf::DescribePercentiles(NetMs),
+		Seconds > 0.f ? TotalOutBytes / Seconds : 0.0, PeakOutBytesPerSecond, TotalOutBytes / 1024.0);
+	FFileHelper::SaveStringToFile(SummaryCSV, *SummaryPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+	UE_LOG(LogBMGameplay, Display, TEXT("Perf recording '%s': %d frames, world tick p95 %.3f ms, written to %s"),
+		*RunLabel, Frames.Num(), BMPerf::Percentile(WorldTickMs, 0.95f), *FramesPath);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BMPerfStartCommand(
+	TEXT("bm.Perf.Start"),
+	TEXT("Starts recording server tick timings and bandwidth. Usage: bm.Perf.Start [Label]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UBMPerfRecorderSubsystem* Recorder = World ? World->GetSubsystem<UBMPerfRecorderSubsystem>() : nullptr;
+		if (Recorder)
+		{
+			Recorder->StartRecording(Args.Num() > 0 ? Args[0] : FString());
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld BMPerfStopCommand(
+	TEXT("bm.Perf.Stop"),
+	TEXT("Stops the perf recording and writes its frame and summary CSV files."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		UBMPerfRecorderSubsystem* Recorder = World ? World->GetSubsystem<UBMPerfRecorderSubsystem>() : nullptr;
+		if (Recorder)
+		{
+			Recorder->StopRecording();
+		}
+	}));
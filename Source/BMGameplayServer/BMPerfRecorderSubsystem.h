@@ -0,0 +1,92 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMPerfRecorderSubsystem.generated.h"
+
+/** Server timings of one world tick */
+struct FBMPerfFrame
+{
+	/** World time at the end of the tick */
+	float Time;
+
+	/** Delta time of the tick, the server tick rate including idle time */
+	float FrameMs;
+
+	/** From receiving packets to replicating, the whole world tick */
+	float WorldTickMs;
+
+	/** Receiving packets and ticking actors */
+	float GameMs;
+
+	/** Replicating actors and sending packets */
+	float NetMs;
+
+	int32 OutBytesPerSecond;
+	int32 NumConnections;
+	int32 NumCharacters;
+};
+
+/**
+ * Records per tick server timings and bandwidth for load tests. Started with -bmperf on the
+ * command line (after WarmupSeconds) or bm.Perf.Start, writes every frame and a summary row of
+ * percentiles to CSV files in the profiling directory so runs of different builds can be compared.
+ * -bmperfseconds=N stops the recording after N seconds and exits, -bmperflabel= names the run.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMPerfRecorderSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UBMPerfRecorderSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	void StartRecording(const FString& Label);
+
+	/** Writes the frame and summary CSV files */
+	void StopRecording();
+
+	FORCEINLINE bool IsRecording() const { return bRecording; }
+
+protected:
+	/** Seconds after the map starts before -bmperf starts recording, skips loading hitches */
+	UPROPERTY(config)
+	float WarmupSeconds;
+
+private:
+	void OnTickDispatch(float DeltaSeconds);
+	void OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds);
+	void OnPostTickFlush();
+
+	void WriteCSV() const;
+
+	FDelegateHandle TickDispatchHandle;
+	FDelegateHandle PostActorTickHandle;
+	FDelegateHandle PostTickFlushHandle;
+
+	TArray<FBMPerfFrame> Frames;
+
+	FString RunLabel;
+
+	bool bRecording;
+
+	/** Started from the command line, waiting for the warmup */
+	bool bAutoStart;
+
+	/** Recording length from the command line, 0 records until stopped */
+	float AutoStopSeconds;
+
+	float RecordStartTime;
+
+	/** Cycles at the phases of the current tick */
+	uint32 TickStartCycles;
+	uint32 PostActorTickCycles;
+
+	float CurrentDeltaSeconds;
+};
@@ -0,0 +1,589 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMPerfRegressionCommandlet.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerCharacter.h"
+#include "BMGameplayServerGameMode.h"
+#include "BMNetQuantization.h"
+#include "BMSphereAttackComponent.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/DamageType.h"
+#include "HAL/MemoryBase.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/CoreNet.h"
+#include "UObject/UObjectGlobals.h"
+
+namespace BMPerfRegression
+{
+	/** Fixed step, the default dedicated server tick rate */
+	static const float DeltaSeconds = 1.f / 30.f;
+
+	/** Edge of the square floor scenarios play on, in cm, centered on the origin */
+	static const float FloorSize = 20000.f;
+
+	/**
+	 * Forwards every call to the real allocator and counts game thread allocations while counting is
+	 * on. Installed as GMalloc for the duration of the commandlet. The instance itself is never freed,
+	 * so a thread that read GMalloc just before it was restored still forwards correctly.
+	 */
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+		static FCountingMalloc& Get()
+		{
+			static FCountingMalloc* Instance = new FCountingMalloc();
+			return *Instance;
+		}
+
+		/** Wraps the current GMalloc, game thread only */
+		void Install()
+		{
+			check(IsInGameThread() && Inner == nullptr);
+			Inner = GMalloc;
+			FPlatformMisc::MemoryBarrier();
+			GMalloc = this;
+		}
+
+		/** Puts the wrapped allocator back, game thread only */
+		void Uninstall()
+		{
+			check(IsInGameThread());
+			if (GMalloc == this)
+			{
+				GMalloc = Inner;
+				FPlatformMisc::MemoryBarrier();
+			}
+			bCounting = false;
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+			{
+				CountAllocation();
+			}
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+			{
+				CountAllocation();
+			}
+			return Inner->TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override
+		{
+			Inner->Free(Original);
+		}
+
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override
+		{
+			return Inner->QuantizeSize(Count, Alignment);
+		}
+
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override
+		{
+			return Inner->GetAllocationSize(Original, SizeOut);
+		}
+
+		virtual void Trim(bool bTrimThreadCaches) override
+		{
+			Inner->Trim(bTrimThreadCaches);
+		}
+
+		virtual void SetupTLSCachesOnCurrentThread() override
+		{
+			Inner->SetupTLSCachesOnCurrentThread();
+		}
+
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override
+		{
+			Inner->ClearAndDisableTLSCachesOnCurrentThread();
+		}
+
+		virtual void InitializeStatsMetadata() override
+		{
+			Inner->InitializeStatsMetadata();
+		}
+
+		virtual void UpdateStats() override
+		{
+			Inner->UpdateStats();
+		}
+
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override
+		{
+			Inner->GetAllocatorStats(OutStats);
+		}
+
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override
+		{
+			Inner->DumpAllocatorStats(Ar);
+		}
+
+		virtual bool ValidateHeap() override
+		{
+			return Inner->ValidateHeap();
+		}
+
+		virtual bool Exec(UWorld* InWorld, const TCHAR* Cmd, FOutputDevice& Ar) override
+		{
+			return Inner->Exec(InWorld, Cmd, Ar);
+		}
+
+		virtual bool IsInternallyThreadSafe() const override
+		{
+			return Inner->IsInternallyThreadSafe();
+		}
+
+		virtual const TCHAR* GetDescriptiveName() override
+		{
+			return TEXT("BMCountingMalloc");
+		}
+
+		/** Game thread only */
+		FORCEINLINE void SetCounting(bool bInCounting) { bCounting = bInCounting; }
+
+		FORCEINLINE int64 GetAllocations() const { return Allocations; }
+
+	private:
+		FCountingMalloc() = default;
+
+		/** Only the game thread touches the flag and the count, so neither needs to be atomic */
+		FORCEINLINE void CountAllocation()
+		{
+			if (IsInGameThread() && bCounting)
+			{
+				Allocations++;
+			}
+		}
+
+		FMalloc* Inner = nullptr;
+		bool bCounting = false;
+		int64 Allocations = 0;
+	};
+
+	/** Installs the counting allocator while in scope, so every return from the commandlet restores GMalloc */
+	struct FScopedCountingMalloc
+	{
+		FScopedCountingMalloc()
+		{
+			FCountingMalloc::Get().Install();
+		}
+
+		~FScopedCountingMalloc()
+		{
+			FCountingMalloc::Get().Uninstall();
+		}
+	};
+
+	/** Counts game thread allocations while in scope, other threads are noise for a fixed scenario */
+	struct FScopedAllocationCounter
+	{
+		FScopedAllocationCounter()
+			: Counting(FCountingMalloc::Get())
+			, StartAllocations(Counting.GetAllocations())
+		{
+			Counting.SetCounting(true);
+		}
+
+		~FScopedAllocationCounter()
+		{
+			Counting.SetCounting(false);
+		}
+
+		int64 GetAllocations() const
+		{
+			return Counting.GetAllocations() - StartAllocations;
+		}
+
+		FCountingMalloc& Counting;
+		int64 StartAllocations;
+	};
+
+	/** Standalone game world with the project's game mode, ticked by hand */
+	struct FScenarioWorld
+	{
+		UWorld* World = nullptr;
+		TSubclassOf<ABMGameplayServerCharacter> CharacterClass;
+		TArray<ABMGameplayServerCharacter*> Characters;
+
+		void Create()
+		{
+			World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("BMPerfRegression"));
+			FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+			WorldContext.SetCurrentWorld(World);
+
+			const FURL URL;
+			World->SetGameMode(URL);
+			SpawnFloor();
+			World->InitializeActorsForPlay(URL);
+			World->BeginPlay();
+		}
+
+		/** Characters walk on it instead of falling forever, its top is at Z = 0 */
+		void SpawnFloor()
+		{
+			UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+			if (Cube == nullptr)
+			{
+				UE_LOG(LogBMGameplay, Warning, TEXT("BMPerfRegression: no floor mesh, characters will fall"));
+				return;
+			}
+
+			// The engine cube is 100 cm on each side, centered on its origin
+			const FTransform FloorTransform(FRotator::ZeroRotator, FVector(0.f, 0.f, -50.f), FVector(FloorSize / 100.f, FloorSize / 100.f, 1.f));
+			AStaticMeshActor* Floor = World->SpawnActor<AStaticMeshActor>(AStaticMeshActor::StaticClass(), FloorTransform);
+			Floor->GetStaticMeshComponent()->SetStaticMesh(Cube);
+		}
+
+		void Destroy()
+		{
+			Characters.Reset();
+			GEngine->DestroyWorldContext(World);
+			World->DestroyWorld(false);
+			World = nullptr;
+			CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+		}
+
+		void Tick(int32 Frames)
+		{
+			for (int32 Frame = 0; Frame < Frames; ++Frame)
+			{
+				World->Tick(LEVELTICK_All, DeltaSeconds);
+				GFrameCounter++;
+			}
+		}
+
+		/** Square grid of characters, Spacing apart, standing on the floor */
+		void SpawnCharacters(int32 Count, float Spacing)
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+			const int32 Columns = FMath::CeilToInt(FMath::Sqrt(float(Count)));
+			const float HalfHeight = CharacterClass->GetDefaultObject<ABMGameplayServerCharacter>()->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+			for (int32 Index = 0; Index < Count; ++Index)
+			{
+				const FVector Location((Index % Columns) * Spacing, (Index / Columns) * Spacing, HalfHeight + 2.f);
+				ABMGameplayServerCharacter* Character = World->SpawnActor<ABMGameplayServerCharacter>(CharacterClass, Location, FRotator::ZeroRotator, SpawnParams);
+				if (Character)
+				{
+					Characters.Add(Character);
+				}
+			}
+		}
+	};
+
+	struct FScenario
+	{
+		const TCHAR* Name;
+
+		/** Builds the scene, not measured */
+		TFunction<void(FScenarioWorld&)> Setup;
+
+		/** The measured phase */
+		TFunction<void(FScenarioWorld&)> Run;
+	};
+
+	struct FResult
+	{
+		FString Scenario;
+		float WallMs;
+		int64 Allocations;
+	};
+
+	static TArray<FScenario> MakeScenarios()
+	{
+		TArray<FScenario> Scenarios;
+
+		// 64 charged spheres released on the same frame: area damage, occlusion traces, damage queue
+		Scenarios.Add({ TEXT("SphereBurst"),
+			[](FScenarioWorld& Scene)
+			{
+				Scene.SpawnCharacters(64, 150.f);
+				Scene.Tick(2);
+				for (ABMGameplayServerCharacter* Character : Scene.Characters)
+				{
+					Character->SphereAttackComp->ServerActivateSphere();
+				}
+				Scene.Tick(30);
+			},
+			[](FScenarioWorld& Scene)
+			{
+				for (ABMGameplayServerCharacter* Character : Scene.Characters)
+				{
+					Character->SphereAttackComp->ServerDeactivateSphere();
+				}
+				Scene.Tick(3);
+			} });
+
+		// 500 projectiles in flight for a second: pool, movement, lag compensation
+		Scenarios.Add({ TEXT("ProjectileFlood"),
+			[](FScenarioWorld& Scene)
+			{
+				Scene.SpawnCharacters(10, 400.f);
+				Scene.Tick(2);
+			},
+			[](FScenarioWorld& Scene)
+			{
+				for (ABMGameplayServerCharacter* Character : Scene.Characters)
+				{
+					const FTransform Muzzle = Character->GetMuzzleTransform();
+					for (int32 Shot = 0; Shot < 50; ++Shot)
+					{
+						// Fanned out and stacked so the projectiles don't start inside each other
+						const FRotator Rotation = Muzzle.Rotator() + FRotator(0.f, Shot * 7.f, 0.f);
+						const FVector Location = Muzzle.GetLocation() + FVector(0.f, 0.f, Shot * 15.f);
+						Character->SpawnProjectile(FTransform(Rotation, Location));
+					}
+				}
+				Scene.Tick(30);
+			} });
+
+		// Every character killed and respawned on the same frame
+		Scenarios.Add({ TEXT("MassRespawn"),
+			[](FScenarioWorld& Scene)
+			{
+				Scene.SpawnCharacters(64, 150.f);
+				Scene.Tick(2);
+			},
+			[](FScenarioWorld& Scene)
+			{
+				ABMGameplayServerGameMode* GameMode = Scene.World->GetAuthGameMode<ABMGameplayServerGameMode>();
+				for (ABMGameplayServerCharacter* Character : Scene.Characters)
+				{
+					UGameplayStatics::ApplyDamage(Character, 1000.f, nullptr, nullptr, UDamageType::StaticClass());
+				}
+				for (ABMGameplayServerCharacter* Character : Scene.Characters)
+				{
+					if (GameMode)
+					{
+						GameMode->Respawn(Character);
+					}
+					else
+					{
+						Character->ResetForRespawn(Character->GetActorLocation());
+					}
+				}
+				Scene.Tick(1);
+			} });
+
+		return Scenarios;
+	}
+
+	template<typename T>
+	static T Median(TArray<T> Values)
+	{
+		Values.Sort();
+		return Values.Num() > 0 ? Values[Values.Num() / 2] : T(0);
+	}
+
+	/** Sends a quantized value through the same net serialization the replication uses */
+	template<typename T>
+	static T NetRoundTrip(T Value, int64& OutBits)
+	{
+		bool bSuccess = true;
+		FNetBitWriter Writer(nullptr, 64);
+		Value.NetSerialize(Writer, nullptr, bSuccess);
+		OutBits = Writer.GetNumBits();
+
+		T Received;
+		FNetBitReader Reader(nullptr, Writer.GetData(), Writer.GetNumBits());
+		Received.NetSerialize(Reader, nullptr, bSuccess);
+		return Received;
+	}
+
+	/** Checks the replicated health and world times stay within their error bounds, returns the number of failed values */
+	static int32 CheckQuantization()
+	{
+		int32 NumFailures = 0;
+		int64 HealthBits = 0;
+		float WorstHealthError = 0.f;
+		for (int32 Step = 0; Step <= 10000; ++Step)
+		{
+			const float Fraction = Step / 10000.f;
+			FBMNetHealth Health;
+			Health.SetFraction(Fraction);
+			const FBMNetHealth Received = NetRoundTrip(Health, HealthBits);
+
+			const float Error = FMath::Abs(Received.GetFraction() - Fraction);
+			WorstHealthError = FMath::Max(WorstHealthError, Error);
+
+			// Alive and damaged have to stay alive and damaged on clients
+			const bool bKeepsLimits = (Fraction > 0.f) == (Received.GetFraction() > 0.f) && (Fraction < 1.f) == (Received.GetFraction() < 1.f);
+			if (!(Received == Health) || Error > BMNetQuantization::MaxHealthFractionError || !bKeepsLimits)
+			{
+				UE_LOG(LogBMGameplay, Error, TEXT("Quantization: health fraction %f replicated as %f"), Fraction, Received.GetFraction());
+				NumFailures++;
+			}
+		}
+
+		// An hour of world time, float rounding of the time itself adds under a millisecond
+		int64 TimeBits = 0;
+		float WorstTimeError = 0.f;
+		for (float Seconds = 0.f; Seconds < 3600.f; Seconds += 0.037f)
+		{
+			FBMNetTime Time;
+			Time.SetSeconds(Seconds);
+			const FBMNetTime Received = NetRoundTrip(Time, TimeBits);
+
+			const float Error = FMath::Abs(Received.GetSeconds() - Seconds);
+			WorstTimeError = FMath::Max(WorstTimeError, Error);
+			if (!(Received == Time) || Error > BMNetQuantization::MaxTimeError + 0.001f)
+			{
+				UE_LOG(LogBMGameplay, Error, TEXT("Quantization: time %f replicated as %f"), Seconds, Received.GetSeconds());
+				NumFailures++;
+			}
+		}
+
+		UE_LOG(LogBMGameplay, Display, TEXT("%-16s health %lld bits, worst error %.5f of max health; times %lld bits at an hour, worst error %.4f s %s"),
+			TEXT("Quantization"), HealthBits, WorstHealthError, TimeBits, WorstTimeError, NumFailures > 0 ? TEXT("FAILED") : TEXT("ok"));
+		return NumFailures;
+	}
+}
+
+UBMPerfRegressionCommandlet::UBMPerfRegressionCommandlet()
+{
+	IsClient = false;
+	IsServer = true;
+	IsEditor = false;
+	LogToConsole = true;
+
+	Iterations = 5;
+	WallTimeTolerance = 0.25f;
+	AllocationTolerance = 0.1f;
+	MinWallMsRegression = 0.5f;
+}
+
+int32 UBMPerfRegressionCommandlet::Main(const FString& Params)
+{
+	using namespace BMPerfRegression;
+
+	FString ScenarioFilter;
+	FParse::Value(*Params, TEXT("scenario="), ScenarioFilter);
+	const bool bUpdateBaseline = FParse::Param(*Params, TEXT("updatebaseline"));
+	const bool bStrictBaseline = FParse::Param(*Params, TEXT("strictbaseline"));
+
+	const int32 NumQuantizationFailures = ScenarioFilter.IsEmpty() || ScenarioFilter == TEXT("Quantization") ? CheckQuantization() : 0;
+
+	// Same pawn players get, with its Blueprint defaults
+	UClass* CharacterClass = GetDefault<ABMGameplayServerGameMode>()->DefaultPawnClass;
+	if (CharacterClass == nullptr || !CharacterClass->IsChildOf(ABMGameplayServerCharacter::StaticClass()))
+	{
+		UE_LOG(LogBMGameplay, Error, TEXT("BMPerfRegression: the default pawn class is not an ABMGameplayServerCharacter"));
+		return 1;
+	}
+
+	// Swap the allocator in before any scenario runs, it is restored when Main returns
+	FScopedCountingMalloc CountingMalloc;
+
+	TArray<FResult> Results;
+	for (const FScenario& Scenario : MakeScenarios())
+	{
+		if (!ScenarioFilter.IsEmpty() && ScenarioFilter != Scenario.Name)
+		{
+			continue;
+		}
+
+		TArray<float> WallMs;
+		TArray<int64> Allocations;
+		for (int32 Iteration = 0; Iteration < FMath::Max(Iterations, 1); ++Iteration)
+		{
+			FScenarioWorld Scene;
+			Scene.CharacterClass = CharacterClass;
+			Scene.Create();
+			Scenario.Setup(Scene);
+
+			{
+				FScopedAllocationCounter AllocationCounter;
+				const double StartTime = FPlatformTime::Seconds();
+				Scenario.Run(Scene);
+				WallMs.Add((FPlatformTime::Seconds() - StartTime) * 1000.0);
+				Allocations.Add(AllocationCounter.GetAllocations());
+			}
+
+			Scene.Destroy();
+		}
+
+		Results.Add({ Scenario.Name, Median(WallMs), Median(Allocations) });
+	}
+
+	int32 NumRegressions = 0;
+	FString ResultsCSV = TEXT("Scenario,WallMs,Allocations,BaselineWallMs,BaselineAllocations,Regressed\n");
+	FString BaselineIni;
+	for (const FResult& Result : Results)
+	{
+		const FBMPerfBaseline* Baseline = Baselines.FindByPredicate([&Result](const FBMPerfBaseline& Entry) { return Entry.Scenario == Result.Scenario; });
+
+		bool bRegressed = false;
+		if (Baseline)
+		{
+			const bool bWallRegressed = Result.WallMs > Baseline->WallMs * (1.f + WallTimeTolerance)
+				&& Result.WallMs - Baseline->WallMs > MinWallMsRegression;
+			const bool bAllocationsRegressed = Result.Allocations > Baseline->Allocations * (1.f + AllocationTolerance);
+			bRegressed = bWallRegressed || bAllocationsRegressed;
+
+			UE_LOG(LogBMGameplay, Display, TEXT("%-16s %8.3f ms (baseline %8.3f) %8lld allocations (baseline %8d) %s"),
+				*Result.Scenario, Result.WallMs, Baseline->WallMs, Result.Allocations, Baseline->Allocations, bRegressed ? TEXT("REGRESSED") : TEXT("ok"));
+		}
+		else
+		{
+			// A scenario nobody recorded could regress unnoticed forever, CI with recorded baselines fails on it
+			bRegressed = bStrictBaseline && !bUpdateBaseline;
+			UE_LOG(LogBMGameplay, Warning, TEXT("%-16s %8.3f ms %8lld allocations, NO BASELINE"), *Result.Scenario, Result.WallMs, Result.Allocations);
+		}
+
+		NumRegressions += bRegressed ? 1 : 0;
+		ResultsCSV += FString::Printf(TEXT("%s,%.3f,%lld,%.3f,%d,%d\n"), *Result.Scenario, Result.WallMs, Result.Allocations,
+			Baseline ? Baseline->WallMs : 0.f, Baseline ? Baseline->Allocations : 0, bRegressed ? 1 : 0);
+		BaselineIni += FString::Printf(TEXT("+Baselines=(Scenario=\"%s\",WallMs=%.3f,Allocations=%lld)\n"), *Result.Scenario, Result.WallMs, Result.Allocations);
+	}
+
+	const FString Directory = FPaths::ProfilingDir() / TEXT("BMPerf");
+	FFileHelper::SaveStringToFile(ResultsCSV, *(Directory / TEXT("BMPerfRegression.csv")));
+
+	if (bUpdateBaseline)
+	{
+		const FString BaselinePath = Directory / TEXT("BMPerfBaseline.ini");
+		FFileHelper::SaveStringToFile(BaselineIni, *BaselinePath);
+		UE_LOG(LogBMGameplay, Display, TEXT("Baseline written to %s, copy it into DefaultGame.ini:\n%s"), *BaselinePath, *BaselineIni);
+	}
+	else if (NumRegressions > 0)
+	{
+		UE_LOG(LogBMGameplay, Error, TEXT("BMPerfRegression: %d of %d scenarios regressed%s"), NumRegressions, Results.Num(),
+			bStrictBaseline ? TEXT(" or have no baseline, record missing ones with -updatebaseline") : TEXT(""));
+	}
+
+	// Recording a baseline accepts the timings, never a quantization error
+	if (NumQuantizationFailures > 0)
+	{
+		UE_LOG(LogBMGameplay, Error, TEXT("BMPerfRegression: %d quantized values exceeded their error bound"), NumQuantizationFailures);
+		return 1;
+	}
+	return !bUpdateBaseline && NumRegressions > 0 ? 1 : 0;
+}
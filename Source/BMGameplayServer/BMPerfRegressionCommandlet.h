@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BMPerfRegressionCommandlet.generated.h"
+
+/** Checked in cost of one scenario on the reference machine */
+USTRUCT()
+struct FBMPerfBaseline
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString Scenario;
+
+	/** Median wall time of the measured phase, in ms */
+	UPROPERTY()
+	float WallMs = 0.f;
+
+	/** Median game thread allocations made during the measured phase */
+	UPROPERTY()
+	int32 Allocations = 0;
+};
+
+/**
+ * Performance regression suite for the gameplay hot paths. Runs fixed scenarios (sphere spells
+ * released at once, hundreds of live projectiles, mass death and respawn) in a fresh game world,
+ * measures the median wall time and game thread allocation count of each and compares them with the
+ * Baselines checked into DefaultGame.ini. Returns non zero when a scenario regressed past its
+ * tolerance, or when replicated health and times quantize past their error bound (the Quantization
+ * check), so CI can run it headless:
+ *
+ *   UE4Editor-Cmd BMGameplayServer.uproject -run=BMPerfRegression -nullrhi -unattended [-scenario=Name] [-updatebaseline] [-strictbaseline]
+ *
+ * A scenario without a baseline only warns, unless -strictbaseline is passed to fail on it once the
+ * baselines are recorded. -updatebaseline writes the measured numbers as ini lines to Saved/Profiling/BMPerf
+ * to copy into DefaultGame.ini.
+ */
+UCLASS(config=Game)
+class UBMPerfRegressionCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UBMPerfRegressionCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+	/** Times each scenario runs, the median is compared */
+	UPROPERTY(config)
+	int32 Iterations;
+
+	/** Allowed wall time growth over the baseline, 0.25 is 25% */
+	UPROPERTY(config)
+	float WallTimeTolerance;
+
+	/** Allowed allocation count growth over the baseline */
+	UPROPERTY(config)
+	float AllocationTolerance;
+
+	/** Wall time differences below this are noise and never fail, in ms */
+	UPROPERTY(config)
+	float MinWallMsRegression;
+
+	UPROPERTY(config)
+	TArray<FBMPerfBaseline> Baselines;
+};
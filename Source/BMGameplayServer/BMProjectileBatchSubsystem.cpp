@@ -0,0 +1,447 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMProjectileBatchSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerCharacter.h"
+#include "BMGameplayServerProjectile.h"
+#include "BMLagCompensationSubsystem.h"
+#include "BMDamageQueueSubsystem.h"
+#include "Components/CapsuleComponent.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+
+DECLARE_CYCLE_STAT(TEXT("Projectile batch tick"), STAT_BMProjectileBatchTick, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Projectile batch simulate"), STAT_BMProjectileBatchSimulate, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Projectile batch resolve"), STAT_BMProjectileBatchResolve, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched projectiles"), STAT_BMProjectileBatchNum, STATGROUP_BMGameplay);
+
+namespace BMProjectileBatch
+{
+	/** Below this many projectiles the parallel passes run inline */
+	static const int32 MinParallelNum = 32;
+
+	/** Same response as UProjectileMovementComponent::ComputeBounceDelta */
+	static FVector ComputeBounceVelocity(const FVector& InVelocity, const FVector& Normal, float Bounciness, float Friction)
+	{
+		FVector OutVelocity = InVelocity;
+		const float VDotNormal = (InVelocity | Normal);
+		if (VDotNormal <= 0.f)
+		{
+			const FVector ProjectedNormal = Normal * -VDotNormal;
+			OutVelocity += ProjectedNormal;
+			OutVelocity *= FMath::Clamp(1.f - Friction, 0.f, 1.f);
+			OutVelocity += ProjectedNormal * FMath::Max(Bounciness, 0.f);
+		}
+		return OutVelocity;
+	}
+}
+
+int32 FBMProjectileBatch::Add(uint16 Id, const FVector& Position, const FVector& Velocity, APawn* Instigator)
+{
+	Ids.Add(Id);
+	Positions.Add(Position);
+	Velocities.Add(Velocity);
+	BounceCounts.Add(0);
+	Lifetimes.Add(Params.LifeSpan);
+	Instigators.Add(Instigator);
+
+	MoveDeltas.AddZeroed();
+	Hits.AddDefaulted();
+	return bHits.Add(false);
+}
+
+void FBMProjectileBatch::RemoveAtSwap(int32 Index)
+{
+	Ids.RemoveAtSwap(Index, 1, false);
+	Positions.RemoveAtSwap(Index, 1, false);
+	Velocities.RemoveAtSwap(Index, 1, false);
+	BounceCounts.RemoveAtSwap(Index, 1, false);
+	Lifetimes.RemoveAtSwap(Index, 1, false);
+	Instigators.RemoveAtSwap(Index, 1, false);
+
+	MoveDeltas.RemoveAtSwap(Index, 1, false);
+	Hits.RemoveAtSwap(Index, 1, false);
+	bHits.RemoveAtSwap(Index, 1, false);
+}
+
+UBMProjectileBatchSubsystem::UBMProjectileBatchSubsystem()
+{
+	bEnabled = false;
+	ProjectileMeshScale = 0.06f;
+	VisualsActor = nullptr;
+	NextProjectileId = 0;
+}
+
+bool UBMProjectileBatchSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+void UBMProjectileBatchSubsystem::Deinitialize()
+{
+	Batches.Empty();
+
+	if (VisualsActor)
+	{
+		VisualsActor->Destroy();
+		VisualsActor = nullptr;
+	}
+
+	Super::Deinitialize();
+}
+
+bool UBMProjectileBatchSubsystem::IsTickable() const
+{
+	return GetNumProjectiles() > 0;
+}
+
+ETickableTickType UBMProjectileBatchSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMProjectileBatchSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMProjectileBatchSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UBMProjectileBatchSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+int32 UBMProjectileBatchSubsystem::GetNumProjectiles() const
+{
+	int32 Num = 0;
+	for (const FBMProjectileBatch& Batch : Batches)
+	{
+		Num += Batch.Num();
+	}
+	return Num;
+}
+
+void UBMProjectileBatchSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMProjectileBatchTick);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, ProjectileBatchTick);
+
+	for (FBMProjectileBatch& Batch : Batches)
+	{
+		if (Batch.Num() > 0)
+		{
+			SimulateBatch(Batch, DeltaTime);
+			ResolveBatch(Batch);
+		}
+
+		UpdateVisuals(Batch);
+
+		INC_DWORD_STAT_BY(STAT_BMProjectileBatchNum, Batch.Num());
+		CSV_CUSTOM_STAT(BMGameplay, BatchedProjectiles, Batch.Num(), ECsvCustomStatOp::Accumulate);
+	}
+}
+
+uint16 UBMProjectileBatchSubsystem::SpawnProjectile(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass, const FVector& Origin, const FVector& Direction, APawn* Instigator)
+{
+	FBMProjectileBatch& Batch = FindOrAddBatch(ProjectileClass);
+
+	const uint16 Id = NextProjectileId++;
+	Batch.Add(Id, Origin, Direction.GetSafeNormal() * Batch.Params.InitialSpeed, Instigator);
+
+	return Id;
+}
+
+void UBMProjectileBatchSubsystem::SpawnSimulatedProjectile(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass, uint16 Id, const FVector& Origin, const FVector& Direction, APawn* Instigator)
+{
+	FBMProjectileBatch& Batch = FindOrAddBatch(ProjectileClass);
+	Batch.Add(Id, Origin, Direction.GetSafeNormal() * Batch.Params.InitialSpeed, Instigator);
+}
+
+void UBMProjectileBatchSubsystem::ImpactSimulatedProjectile(uint16 Id, const FVector& Location)
+{
+	for (FBMProjectileBatch& Batch : Batches)
+	{
+		const int32 Index = Batch.Ids.Find(Id);
+		if (Index != INDEX_NONE)
+		{
+			// Local flight may already have ended it, otherwise the server result wins
+			Batch.RemoveAtSwap(Index);
+			UpdateVisuals(Batch);
+			return;
+		}
+	}
+}
+
+FBMProjectileBatch& UBMProjectileBatchSubsystem::FindOrAddBatch(UClass* ProjectileClass)
+{
+	for (FBMProjectileBatch& Batch : Batches)
+	{
+		if (Batch.ProjectileClass == ProjectileClass)
+		{
+			return Batch;
+		}
+	}
+
+	FBMProjectileBatch& Batch = Batches.AddDefaulted_GetRef();
+	Batch.ProjectileClass = ProjectileClass;
+
+	// Flight parameters come from the projectile class so both modes behave the same
+	const ABMGameplayServerProjectile* DefaultProjectile = ProjectileClass ? ProjectileClass->GetDefaultObject<ABMGameplayServerProjectile>() : nullptr;
+	if (DefaultProjectile)
+	{
+		const USphereComponent* Collision = DefaultProjectile->GetCollisionComp();
+		const UProjectileMovementComponent* Movement = DefaultProjectile->GetProjectileMovement();
+
+		Batch.Params.Radius = Collision->GetUnscaledSphereRadius();
+		Batch.Params.CollisionChannel = Collision->GetCollisionObjectType();
+		Batch.Params.ResponseParams = FCollisionResponseParams(Collision->GetCollisionResponseToChannels());
+		Batch.Params.Damage = DefaultProjectile->GetDamage();
+		Batch.Params.LifeSpan = DefaultProjectile->InitialLifeSpan > 0.f ? DefaultProjectile->InitialLifeSpan : 3.0f;
+		Batch.Params.InitialSpeed = Movement->InitialSpeed;
+		Batch.Params.MaxSpeed = Movement->MaxSpeed;
+		Batch.Params.GravityZ = GetWorld()->GetGravityZ() * Movement->ProjectileGravityScale;
+		Batch.Params.Bounciness = Movement->Bounciness;
+		Batch.Params.Friction = Movement->Friction;
+		Batch.Params.BounceStopSpeed = Movement->BounceVelocityStopSimulatingThreshold;
+		Batch.Params.bShouldBounce = Movement->bShouldBounce;
+	}
+
+	// Clients draw the batch with one instanced mesh
+	if (!IsRunningDedicatedServer())
+	{
+		UStaticMesh* Mesh = Cast<UStaticMesh>(ProjectileMesh.TryLoad());
+		if (Mesh)
+		{
+			if (VisualsActor == nullptr)
+			{
+				FActorSpawnParameters SpawnParams;
+				SpawnParams.ObjectFlags |= RF_Transient;
+				VisualsActor = GetWorld()->SpawnActor<AActor>(SpawnParams);
+			}
+
+			if (VisualsActor)
+			{
+				Batch.Visuals = NewObject<UInstancedStaticMeshComponent>(VisualsActor);
+				Batch.Visuals->SetStaticMesh(Mesh);
+				Batch.Visuals->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+				Batch.Visuals->SetMobility(EComponentMobility::Movable);
+				if (VisualsActor->GetRootComponent() == nullptr)
+				{
+					VisualsActor->SetRootComponent(Batch.Visuals);
+				}
+				Batch.Visuals->RegisterComponent();
+			}
+		}
+	}
+
+	return Batch;
+}
+
+UBMLagCompensationSubsystem* UBMProjectileBatchSubsystem::GetLagCompensation() const
+{
+	if (GetWorld()->GetNetMode() == NM_Client)
+	{
+		return nullptr;
+	}
+
+	UBMLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<UBMLagCompensationSubsystem>();
+	return (LagCompensation && LagCompensation->IsEnabled()) ? LagCompensation : nullptr;
+}
+
+void UBMProjectileBatchSubsystem::SimulateBatch(FBMProjectileBatch& Batch, float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMProjectileBatchSimulate);
+
+	const FBMProjectileBatchParams& Params = Batch.Params;
+	const int32 Num = Batch.Num();
+	const bool bSingleThread = Num < BMProjectileBatch::MinParallelNum;
+
+	FVector* RESTRICT Positions = Batch.Positions.GetData();
+	FVector* RESTRICT Velocities = Batch.Velocities.GetData();
+	FVector* RESTRICT MoveDeltas = Batch.MoveDeltas.GetData();
+	float* RESTRICT Lifetimes = Batch.Lifetimes.GetData();
+
+	// Integrate, same step as UProjectileMovementComponent::ComputeMoveDelta
+	const FVector Acceleration(0.f, 0.f, Params.GravityZ);
+	ParallelFor(Num, [&](int32 Index)
+	{
+		Lifetimes[Index] -= DeltaTime;
+
+		const FVector& OldVelocity = Velocities[Index];
+		if (OldVelocity.IsZero())
+		{
+			// Stopped after its last bounce, stays put until it expires
+			MoveDeltas[Index] = FVector::ZeroVector;
+			return;
+		}
+
+		MoveDeltas[Index] = (OldVelocity * DeltaTime) + (Acceleration * (0.5f * FMath::Square(DeltaTime)));
+		Velocities[Index] = (OldVelocity + Acceleration * DeltaTime).GetClampedToMaxSize(Params.MaxSpeed);
+	}, bSingleThread);
+
+	// Sweep every moving projectile, scene queries are safe to run from worker threads
+	UWorld* World = GetWorld();
+	const FCollisionShape Shape = FCollisionShape::MakeSphere(Params.Radius);
+	FHitResult* Hits = Batch.Hits.GetData();
+	bool* bHits = Batch.bHits.GetData();
+
+	// With lag compensation characters are tested at their rewound capsules in ResolveBatch instead
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(BMProjectileBatch), false);
+	UBMLagCompensationSubsystem* LagCompensation = GetLagCompensation();
+	if (LagCompensation)
+	{
+		IgnoredCharacters.Reset();
+		LagCompensation->GetRegisteredCharacters(IgnoredCharacters);
+		QueryParams.AddIgnoredActors(IgnoredCharacters);
+	}
+
+	ParallelFor(Num, [&](int32 Index)
+	{
+		bHits[Index] = false;
+		if (MoveDeltas[Index].IsZero())
+		{
+			return;
+		}
+
+		const FVector Start = Positions[Index];
+		bHits[Index] = World->SweepSingleByChannel(Hits[Index], Start, Start + MoveDeltas[Index], FQuat::Identity,
+			Params.CollisionChannel, Shape, QueryParams, Params.ResponseParams);
+	}, bSingleThread);
+}
+
+void UBMProjectileBatchSubsystem::ResolveBatch(FBMProjectileBatch& Batch)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMProjectileBatchResolve);
+
+	UBMLagCompensationSubsystem* LagCompensation = GetLagCompensation();
+
+	// Backwards so swap removal does not skip entries
+	for (int32 Index = Batch.Num() - 1; Index >= 0; --Index)
+	{
+		// Characters where the shooter saw them, up to the world hit
+		if (LagCompensation && !Batch.MoveDeltas[Index].IsZero())
+		{
+			APawn* Instigator = Batch.Instigators[Index].Get();
+			const FVector Start = Batch.Positions[Index];
+			const FVector End = Batch.bHits[Index] ? Batch.Hits[Index].Location : Start + Batch.MoveDeltas[Index];
+			const float ViewTime = LagCompensation->GetViewTime(Instigator ? Instigator->GetController() : nullptr);
+
+			FVector RewoundLocation;
+			ABMGameplayServerCharacter* RewoundCharacter = LagCompensation->SweepSphere(Start, End, Batch.Params.Radius, ViewTime, Instigator, RewoundLocation);
+			if (RewoundCharacter)
+			{
+				const FHitResult RewoundHit(RewoundCharacter, RewoundCharacter->GetCapsuleComponent(), RewoundLocation, (Start - End).GetSafeNormal());
+				if (HandleHit(Batch, Index, RewoundHit))
+				{
+					Batch.RemoveAtSwap(Index);
+					continue;
+				}
+			}
+		}
+
+		if (Batch.bHits[Index])
+		{
+			const FHitResult& Hit = Batch.Hits[Index];
+			if (HandleHit(Batch, Index, Hit))
+			{
+				Batch.RemoveAtSwap(Index);
+				continue;
+			}
+
+			// Bounce off, the rest of this frame's move is dropped
+			Batch.Positions[Index] = Hit.Location + Hit.Normal * (Hit.bStartPenetrating ? Hit.PenetrationDepth : 0.1f);
+			if (Batch.Params.bShouldBounce)
+			{
+				FVector& Velocity = Batch.Velocities[Index];
+				Velocity = BMProjectileBatch::ComputeBounceVelocity(Velocity, Hit.Normal, Batch.Params.Bounciness, Batch.Params.Friction);
+				if (Velocity.SizeSquared() < FMath::Square(Batch.Params.BounceStopSpeed))
+				{
+					Velocity = FVector::ZeroVector;
+				}
+				Batch.BounceCounts[Index] = FMath::Min<int32>(Batch.BounceCounts[Index] + 1, MAX_uint8);
+			}
+			else
+			{
+				Batch.Velocities[Index] = FVector::ZeroVector;
+			}
+		}
+		else
+		{
+			Batch.Positions[Index] += Batch.MoveDeltas[Index];
+		}
+
+		if (Batch.Lifetimes[Index] <= 0.f)
+		{
+			Batch.RemoveAtSwap(Index);
+		}
+	}
+}
+
+bool UBMProjectileBatchSubsystem::HandleHit(FBMProjectileBatch& Batch, int32 Index, const FHitResult& Hit)
+{
+	AActor* OtherActor = Hit.GetActor();
+	UPrimitiveComponent* OtherComp = Hit.GetComponent();
+	APawn* Instigator = Batch.Instigators[Index].Get();
+	const FVector Velocity = Batch.Velocities[Index];
+	bool bConsumed = false;
+
+	if (GetWorld()->GetNetMode() != NM_Client)
+	{
+		if ((OtherActor != NULL) && (Instigator != OtherActor))
+		{
+			UBMDamageQueueSubsystem::QueueOrApplyDamage(OtherActor, Batch.Params.Damage, Instigator ? Instigator->GetController() : nullptr, Instigator);
+			bConsumed = true;
+		}
+	}
+
+	if ((OtherActor != NULL) && (OtherComp != NULL) && OtherComp->IsSimulatingPhysics())
+	{
+		OtherComp->AddImpulseAtLocation(Velocity * 10.0f, Hit.Location);
+		bConsumed = true;
+	}
+
+	// Tell clients where it ended
+	if (bConsumed && GetWorld()->GetNetMode() != NM_Client)
+	{
+		ABMGameplayServerCharacter* Character = Cast<ABMGameplayServerCharacter>(Instigator);
+		if (Character)
+		{
+			Character->MulticastBatchedProjectileImpact(Batch.Ids[Index], Hit.Location);
+		}
+	}
+
+	return bConsumed;
+}
+
+void UBMProjectileBatchSubsystem::UpdateVisuals(FBMProjectileBatch& Batch)
+{
+	UInstancedStaticMeshComponent* Visuals = Batch.Visuals;
+	if (Visuals == nullptr)
+	{
+		return;
+	}
+
+	// Instance i draws projectile i, only the count changes at the end
+	const int32 Num = Batch.Num();
+	while (Visuals->GetInstanceCount() > Num)
+	{
+		Visuals->RemoveInstance(Visuals->GetInstanceCount() - 1);
+	}
+	while (Visuals->GetInstanceCount() < Num)
+	{
+		Visuals->AddInstanceWorldSpace(FTransform::Identity);
+	}
+
+	const FVector Scale(ProjectileMeshScale);
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		const FTransform Transform(Batch.Velocities[Index].Rotation(), Batch.Positions[Index], Scale);
+		Visuals->UpdateInstanceTransform(Index, Transform, true, Index == Num - 1, true);
+	}
+}
@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Engine/EngineTypes.h"
+#include "CollisionQueryParams.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMProjectileBatchSubsystem.generated.h"
+
+class ABMGameplayServerProjectile;
+class UInstancedStaticMeshComponent;
+class UBMLagCompensationSubsystem;
+
+/** Flight parameters of a projectile class, read once from its class default object */
+struct FBMProjectileBatchParams
+{
+	float Radius = 5.0f;
+	float Damage = 10.0f;
+	float InitialSpeed = 3000.0f;
+	float MaxSpeed = 3000.0f;
+	float GravityZ = 0.0f;
+	float Bounciness = 0.6f;
+	float Friction = 0.2f;
+	float BounceStopSpeed = 5.0f;
+	float LifeSpan = 3.0f;
+	bool bShouldBounce = true;
+	ECollisionChannel CollisionChannel = ECC_WorldDynamic;
+	FCollisionResponseParams ResponseParams;
+};
+
+/** All live projectiles of one class, stored as structure of arrays */
+USTRUCT()
+struct FBMProjectileBatch
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UClass* ProjectileClass = nullptr;
+
+	/** Instanced mesh drawing the batch on clients */
+	UPROPERTY()
+	UInstancedStaticMeshComponent* Visuals = nullptr;
+
+	FBMProjectileBatchParams Params;
+
+	TArray<uint16> Ids;
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<uint8> BounceCounts;
+	TArray<float> Lifetimes;
+	TArray<TWeakObjectPtr<APawn>> Instigators;
+
+	/** Per frame scratch, sized with the batch */
+	TArray<FVector> MoveDeltas;
+	TArray<FHitResult> Hits;
+	TArray<bool> bHits;
+
+	FORCEINLINE int32 Num() const { return Ids.Num(); }
+
+	int32 Add(uint16 Id, const FVector& Position, const FVector& Velocity, APawn* Instigator);
+
+	void RemoveAtSwap(int32 Index);
+};
+
+/**
+ * Opt-in replacement for projectile actors. One manager per world stores every live projectile
+ * in structure of arrays form and advances all of them with a single ParallelFor plus a batch
+ * of parallel sweeps. The server applies the same hit rules as ABMGameplayServerProjectile::OnHit
+ * and only replicates spawn and impact events, clients simulate the flight themselves.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMProjectileBatchSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UBMProjectileBatchSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/** Batched mode is enabled for this world */
+	FORCEINLINE bool IsEnabled() const { return bEnabled; }
+
+	/** Starts an authoritative projectile. Server only, returns the id replicated in spawn/impact events */
+	uint16 SpawnProjectile(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass, const FVector& Origin, const FVector& Direction, APawn* Instigator);
+
+	/** Starts a cosmetic projectile from a replicated spawn event. Clients only */
+	void SpawnSimulatedProjectile(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass, uint16 Id, const FVector& Origin, const FVector& Direction, APawn* Instigator);
+
+	/** Ends a cosmetic projectile from a replicated impact event. Clients only */
+	void ImpactSimulatedProjectile(uint16 Id, const FVector& Location);
+
+	/** Live projectiles in all batches */
+	int32 GetNumProjectiles() const;
+
+protected:
+	/** Use batched projectiles instead of projectile actors */
+	UPROPERTY(config)
+	bool bEnabled;
+
+	/** Mesh drawn for batched projectiles on clients */
+	UPROPERTY(config)
+	FSoftObjectPath ProjectileMesh;
+
+	/** Uniform scale of the projectile mesh */
+	UPROPERTY(config)
+	float ProjectileMeshScale;
+
+private:
+	FBMProjectileBatch& FindOrAddBatch(UClass* ProjectileClass);
+
+	/** Integrates and sweeps every projectile of the batch in parallel */
+	void SimulateBatch(FBMProjectileBatch& Batch, float DeltaTime);
+
+	/** Applies hits, bounces and expiry on the game thread */
+	void ResolveBatch(FBMProjectileBatch& Batch);
+
+	/** Same rules as ABMGameplayServerProjectile::OnHit. Returns true if the projectile is consumed */
+	bool HandleHit(FBMProjectileBatch& Batch, int32 Index, const FHitResult& Hit);
+
+	void UpdateVisuals(FBMProjectileBatch& Batch);
+
+	/** Lag compensation to validate pawn hits with, server only */
+	UBMLagCompensationSubsystem* GetLagCompensation() const;
+
+	UPROPERTY(Transient)
+	TArray<FBMProjectileBatch> Batches;
+
+	/** Owner of the instanced mesh components */
+	UPROPERTY(Transient)
+	AActor* VisualsActor;
+
+	/** Scratch list of characters left out of the physics sweeps */
+	TArray<AActor*> IgnoredCharacters;
+
+	uint16 NextProjectileId;
+};
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMProjectilePoolSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerProjectile.h"
+#include "Engine/World.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectile pool hits"), STAT_BMProjectilePoolHits, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectile pool misses"), STAT_BMProjectilePoolMisses, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectile pool high-water mark"), STAT_BMProjectilePoolHighWater, STATGROUP_BMGameplay);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled projectiles in use"), STAT_BMProjectilePoolInUse, STATGROUP_BMGameplay);
+
+UBMProjectilePoolSubsystem::UBMProjectilePoolSubsystem()
+{
+	PrewarmSize = 32;
+
+	NumHits = 0;
+	NumMisses = 0;
+	NumInUse = 0;
+	HighWaterMark = 0;
+}
+
+bool UBMProjectilePoolSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+void UBMProjectilePoolSubsystem::Deinitialize()
+{
+	UE_LOG(LogBMGameplay, Log, TEXT("Projectile pool: %d hits, %d misses, high-water mark %d"), NumHits, NumMisses, HighWaterMark);
+
+	DEC_DWORD_STAT_BY(STAT_BMProjectilePoolInUse, NumInUse);
+	Pools.Empty();
+
+	Super::Deinitialize();
+}
+
+void UBMProjectilePoolSubsystem::Prewarm(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass)
+{
+	if (ProjectileClass == nullptr || Pools.Contains(ProjectileClass))
+	{
+		return;
+	}
+
+	FBMProjectilePool& Pool = Pools.Add(ProjectileClass);
+	Pool.Free.Reserve(PrewarmSize);
+
+	for (int32 i = 0; i < PrewarmSize; i++)
+	{
+		ABMGameplayServerProjectile* Projectile = SpawnPooledProjectile(ProjectileClass, FTransform::Identity);
+		if (Projectile)
+		{
+			Projectile->DeactivateToPool();
+			Pool.Free.Add(Projectile);
+		}
+	}
+}
+
+ABMGameplayServerProjectile* UBMProjectilePoolSubsystem::AcquireProjectile(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass, const FTransform& SpawnTransform, AActor* Owner, APawn* Instigator)
+{
+	if (ProjectileClass == nullptr)
+	{
+		return nullptr;
+	}
+
+	FBMProjectilePool& Pool = Pools.FindOrAdd(ProjectileClass);
+
+	ABMGameplayServerProjectile* Projectile = nullptr;
+	while (Pool.Free.Num() > 0 && Projectile == nullptr)
+	{
+		// Projectiles destroyed behind our back (level unload, GC) are dropped
+		Projectile = Pool.Free.Pop(false);
+		if (!IsValid(Projectile))
+		{
+			Projectile = nullptr;
+		}
+	}
+
+	if (Projectile)
+	{
+		NumHits++;
+		INC_DWORD_STAT(STAT_BMProjectilePoolHits);
+	}
+	else
+	{
+		// Pool grows on demand
+		Projectile = SpawnPooledProjectile(ProjectileClass, SpawnTransform);
+		if (Projectile == nullptr)
+		{
+			return nullptr;
+		}
+
+		NumMisses++;
+		INC_DWORD_STAT(STAT_BMProjectilePoolMisses);
+	}
+
+	Projectile->ActivateFromPool(SpawnTransform, Owner, Instigator);
+
+	NumInUse++;
+	INC_DWORD_STAT(STAT_BMProjectilePoolInUse);
+
+	if (NumInUse > HighWaterMark)
+	{
+		HighWaterMark = NumInUse;
+		SET_DWORD_STAT(STAT_BMProjectilePoolHighWater, HighWaterMark);
+	}
+
+	return Projectile;
+}
+
+void UBMProjectilePoolSubsystem::ReleaseProjectile(ABMGameplayServerProjectile* Projectile)
+{
+	if (!IsValid(Projectile) || Projectile->IsParked())
+	{
+		return;
+	}
+
+	Projectile->DeactivateToPool();
+
+	Pools.FindOrAdd(Projectile->GetClass()).Free.Add(Projectile);
+
+	if (NumInUse > 0)
+	{
+		NumInUse--;
+		DEC_DWORD_STAT(STAT_BMProjectilePoolInUse);
+	}
+}
+
+ABMGameplayServerProjectile* UBMProjectilePoolSubsystem::SpawnPooledProjectile(UClass* ProjectileClass, const FTransform& SpawnTransform)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	ABMGameplayServerProjectile* Projectile = GetWorld()->SpawnActor<ABMGameplayServerProjectile>(ProjectileClass, SpawnTransform, SpawnParams);
+	if (Projectile)
+	{
+		Projectile->SetPooled(true);
+	}
+
+	return Projectile;
+}
@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMProjectilePoolSubsystem.generated.h"
+
+class ABMGameplayServerProjectile;
+
+/** Parked projectiles of one class */
+USTRUCT()
+struct FBMProjectilePool
+{
+	GENERATED_BODY()
+
+	/** Projectiles ready to be handed out */
+	UPROPERTY()
+	TArray<ABMGameplayServerProjectile*> Free;
+};
+
+/**
+ * Per world pool of projectile actors. Projectiles are parked (hidden, no collision, net dormant)
+ * instead of destroyed and handed out again on the next shot, avoiding actor spawn, channel
+ * open/close and garbage collection on every shot. Server only.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMProjectilePoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UBMProjectilePoolSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Deinitialize() override;
+
+	/** Fills the pool of the given class up to PrewarmSize. Does nothing once the class has been warmed */
+	void Prewarm(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass);
+
+	/** Hands out a parked projectile or spawns a new one if the pool is empty */
+	ABMGameplayServerProjectile* AcquireProjectile(TSubclassOf<ABMGameplayServerProjectile> ProjectileClass, const FTransform& SpawnTransform, AActor* Owner, APawn* Instigator);
+
+	/** Parks the projectile until it is acquired again */
+	void ReleaseProjectile(ABMGameplayServerProjectile* Projectile);
+
+	/** Acquires served from the pool */
+	FORCEINLINE int32 GetNumHits() const { return NumHits; }
+
+	/** Acquires that had to spawn a new actor */
+	FORCEINLINE int32 GetNumMisses() const { return NumMisses; }
+
+	/** Maximum number of projectiles in flight at once */
+	FORCEINLINE int32 GetHighWaterMark() const { return HighWaterMark; }
+
+protected:
+	/** Projectiles spawned per class when the pool is warmed */
+	UPROPERTY(config)
+	int32 PrewarmSize;
+
+private:
+	/** Spawns a new pooled projectile, parked */
+	ABMGameplayServerProjectile* SpawnPooledProjectile(UClass* ProjectileClass, const FTransform& SpawnTransform);
+
+	UPROPERTY(Transient)
+	TMap<UClass*, FBMProjectilePool> Pools;
+
+	int32 NumHits;
+	int32 NumMisses;
+	int32 NumInUse;
+	int32 HighWaterMark;
+};
@@ -0,0 +1,294 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMReplicationGraph.h"
+
+#include "BMGameplayServer.h"
+#include "BMGameplayServerCharacter.h"
+#include "BMGameplayServerProjectile.h"
+#include "BMNetReportSubsystem.h"
+#include "Engine/LevelScriptActor.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/Info.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "ReplicationGraphTypes.h"
+
+DECLARE_CYCLE_STAT(TEXT("Replication graph net tick"), STAT_BMRepGraphNetTick, STATGROUP_BMGameplay);
+
+void UBMReplicationGraphNode_OwnerOnly::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	ReplicationActorList.Reset();
+
+	for (const FNetViewer& Viewer : Params.Viewers)
+	{
+		ReplicationActorList.ConditionalAdd(Viewer.InViewer);
+		ReplicationActorList.ConditionalAdd(Viewer.ViewTarget);
+
+		const APlayerController* PlayerController = Cast<APlayerController>(Viewer.InViewer);
+		if (PlayerController)
+		{
+			ReplicationActorList.ConditionalAdd(PlayerController->PlayerState);
+			ReplicationActorList.ConditionalAdd(PlayerController->GetPawn());
+		}
+	}
+
+	Params.OutGatheredReplicationLists.AddReplicationActorList(ReplicationActorList);
+}
+
+UBMReplicationGraph::UBMReplicationGraph()
+{
+	GridCellSize = 10000.f;
+	SpatialBias = FVector2D(-100000.f, -100000.f);
+	CharacterCullDistance = 15000.f;
+	ProjectileCullDistance = 10000.f;
+	bDisableSpatialRebuilds = true;
+
+	GridNode = nullptr;
+	AlwaysRelevantNode = nullptr;
+
+	NetTickSeconds = 0.0;
+	NetTickMaxSeconds = 0.0;
+	NetTickCount = 0;
+	NetTickConnections = 0;
+
+	AutoReportSeconds = 0.f;
+	LastReportTime = 0.0;
+	if (!HasAnyFlags(RF_ClassDefaultObject))
+	{
+		FParse::Value(FCommandLine::Get(), TEXT("bmrepgraphreport="), AutoReportSeconds);
+	}
+}
+
+void UBMReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	// Owner only and always relevant flags are resolved here once instead of per actor per connection
+	for (TObjectIterator<UClass> It; It; ++It)
+	{
+		UClass* Class = *It;
+		const AActor* ActorCDO = Cast<AActor>(Class->GetDefaultObject());
+		if (ActorCDO == nullptr || !ActorCDO->GetIsReplicated())
+		{
+			continue;
+		}
+
+		// Skip blueprint compilation leftovers
+		if (Class->GetName().StartsWith(TEXT("SKEL_")) || Class->GetName().StartsWith(TEXT("REINST_")))
+		{
+			continue;
+		}
+
+		EBMClassRepNodeMapping Mapping;
+		if (ActorCDO->bOnlyRelevantToOwner)
+		{
+			Mapping = EBMClassRepNodeMapping::NotRouted;
+		}
+		else if (ActorCDO->bAlwaysRelevant || Class->IsChildOf(AInfo::StaticClass()) || Class->IsChildOf(ALevelScriptActor::StaticClass()))
+		{
+			Mapping = EBMClassRepNodeMapping::RelevantAllConnections;
+		}
+		else if (ActorCDO->NetDormancy >= DORM_DormantAll || Class->IsChildOf(ABMGameplayServerProjectile::StaticClass()))
+		{
+			// Pooled projectiles park dormant between shots
+			Mapping = EBMClassRepNodeMapping::Spatialize_Dormancy;
+		}
+		else if (ActorCDO->GetRootComponent() && ActorCDO->GetRootComponent()->Mobility == EComponentMobility::Static)
+		{
+			Mapping = EBMClassRepNodeMapping::Spatialize_Static;
+		}
+		else
+		{
+			Mapping = EBMClassRepNodeMapping::Spatialize_Dynamic;
+		}
+		ClassRepNodePolicies.Set(Class, Mapping);
+
+		if (Mapping == EBMClassRepNodeMapping::NotRouted || Mapping == EBMClassRepNodeMapping::RelevantAllConnections)
+		{
+			continue;
+		}
+
+		FClassReplicationInfo ClassInfo;
+		ClassInfo.ReplicationPeriodFrame = GetReplicationPeriodFrameForFrequency(ActorCDO->NetUpdateFrequency);
+		if (Class->IsChildOf(ABMGameplayServerCharacter::StaticClass()))
+		{
+			ClassInfo.CullDistanceSquared = FMath::Square(CharacterCullDistance);
+		}
+		else if (Class->IsChildOf(ABMGameplayServerProjectile::StaticClass()))
+		{
+			ClassInfo.CullDistanceSquared = FMath::Square(ProjectileCullDistance);
+		}
+		else
+		{
+			ClassInfo.CullDistanceSquared = ActorCDO->NetCullDistanceSquared;
+		}
+		GlobalActorReplicationInfoMap.SetClassInfo(Class, ClassInfo);
+	}
+}
+
+void UBMReplicationGraph::InitGlobalGraphNodes()
+{
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = GridCellSize;
+	GridNode->SpatialBias = SpatialBias;
+	if (bDisableSpatialRebuilds)
+	{
+		GridNode->AddSpatialRebuildBlacklistClass(AActor::StaticClass());
+	}
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+}
+
+void UBMReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	UBMReplicationGraphNode_OwnerOnly* OwnerOnlyNode = CreateNewNode<UBMReplicationGraphNode_OwnerOnly>();
+	AddConnectionGraphNode(OwnerOnlyNode, RepGraphConnection);
+}
+
+void UBMReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	const EBMClassRepNodeMapping* Mapping = ClassRepNodePolicies.Get(ActorInfo.Class);
+	switch (Mapping ? *Mapping : EBMClassRepNodeMapping::Spatialize_Dynamic)
+	{
+	case EBMClassRepNodeMapping::NotRouted:
+		break;
+	case EBMClassRepNodeMapping::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+	case EBMClassRepNodeMapping::Spatialize_Static:
+		GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+		break;
+	case EBMClassRepNodeMapping::Spatialize_Dynamic:
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		break;
+	case EBMClassRepNodeMapping::Spatialize_Dormancy:
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+		break;
+	}
+}
+
+void UBMReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	const EBMClassRepNodeMapping* Mapping = ClassRepNodePolicies.Get(ActorInfo.Class);
+	switch (Mapping ? *Mapping : EBMClassRepNodeMapping::Spatialize_Dynamic)
+	{
+	case EBMClassRepNodeMapping::NotRouted:
+		break;
+	case EBMClassRepNodeMapping::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+	case EBMClassRepNodeMapping::Spatialize_Static:
+		GridNode->RemoveActor_Static(ActorInfo);
+		break;
+	case EBMClassRepNodeMapping::Spatialize_Dynamic:
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		break;
+	case EBMClassRepNodeMapping::Spatialize_Dormancy:
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+		break;
+	}
+}
+
+int32 UBMReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMRepGraphNetTick);
+
+	const double StartTime = FPlatformTime::Seconds();
+	const int32 Result = Super::ServerReplicateActors(DeltaSeconds);
+	const double EndTime = FPlatformTime::Seconds();
+	NetTickSeconds += EndTime - StartTime;
+	NetTickMaxSeconds = FMath::Max(NetTickMaxSeconds, EndTime - StartTime);
+	NetTickCount++;
+	NetTickConnections = NetDriver ? NetDriver->ClientConnections.Num() : 0;
+
+	if (AutoReportSeconds > 0.f)
+	{
+		if (LastReportTime == 0.0)
+		{
+			LastReportTime = EndTime;
+		}
+		else if (EndTime - LastReportTime >= AutoReportSeconds)
+		{
+			LogNetTickReport();
+			LastReportTime = EndTime;
+		}
+	}
+
+	return Result;
+}
+
+bool UBMReplicationGraph::ProcessRemoteFunction(AActor* Actor, UFunction* Function, void* Parameters, FOutParmRec* OutParms, FFrame* Stack, UObject* SubObject)
+{
+	UBMNetReportSubsystem* NetReport = GetWorld() ? GetWorld()->GetSubsystem<UBMNetReportSubsystem>() : nullptr;
+	if (NetReport && NetReport->IsEnabled())
+	{
+		NetReport->NoteRemoteFunction(Actor, Function, Parameters, SubObject);
+	}
+
+	return Super::ProcessRemoteFunction(Actor, Function, Parameters, OutParms, Stack, SubObject);
+}
+
+void UBMReplicationGraph::LogNetTickReport()
+{
+	const double AverageMs = NetTickCount > 0 ? NetTickSeconds * 1000.0 / NetTickCount : 0.0;
+	UE_LOG(LogBMGameplay, Display, TEXT("Replication graph: %d connections, %d net ticks, %.3f ms average net tick, %.3f ms worst"),
+		NetTickConnections, NetTickCount, AverageMs, NetTickMaxSeconds * 1000.0);
+
+	// Rows of every benchmark run end up in one file, labelled like the perf recorder's
+	if (AutoReportSeconds > 0.f && NetTickCount > 0)
+	{
+		FString Label;
+		if (!FParse::Value(FCommandLine::Get(), TEXT("bmperflabel="), Label))
+		{
+			Label = FApp::GetBuildVersion();
+		}
+
+		const FString Path = FPaths::ProfilingDir() / TEXT("BMPerf") / TEXT("BMRepGraph.csv");
+		FString Row;
+		if (!IFileManager::Get().FileExists(*Path))
+		{
+			Row = TEXT("Run,Time,Connections,NetTicks,AvgNetTickMs,MaxNetTickMs\n");
+		}
+		Row += FString::Printf(TEXT("%s,%s,%d,%d,%.3f,%.3f\n"), *Label, *FDateTime::Now().ToString(),
+			NetTickConnections, NetTickCount, AverageMs, NetTickMaxSeconds * 1000.0);
+		FFileHelper::SaveStringToFile(Row, *Path, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+	}
+
+	NetTickSeconds = 0.0;
+	NetTickMaxSeconds = 0.0;
+	NetTickCount = 0;
+}
+
+/**
+ * bm.RepGraph.Report
+ * Logs the average net tick cost of the replication graph since the last report.
+ * Scripts/RunRepGraphBenchmark.sh collects it with 16, 64 and 128 connected clients.
+ */
+static FAutoConsoleCommandWithWorld BMRepGraphReportCommand(
+	TEXT("bm.RepGraph.Report"),
+	TEXT("Logs the average replication graph net tick cost and connection count since the last report."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+		UBMReplicationGraph* Graph = NetDriver ? Cast<UBMReplicationGraph>(NetDriver->GetReplicationDriver()) : nullptr;
+		if (Graph)
+		{
+			Graph->LogNetTickReport();
+		}
+		else
+		{
+			UE_LOG(LogBMGameplay, Display, TEXT("Replication graph is not active on this world's net driver."));
+		}
+	}));
@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "BMReplicationGraph.generated.h"
+
+class UReplicationGraphNode_GridSpatialization2D;
+class UReplicationGraphNode_ActorList;
+
+/** How actors of a class are routed to the graph nodes */
+enum class EBMClassRepNodeMapping : uint8
+{
+	/** Not routed to any node, replicated by per connection nodes only */
+	NotRouted,
+	/** Replicated to every connection */
+	RelevantAllConnections,
+	/** Spatialized, never moves */
+	Spatialize_Static,
+	/** Spatialized, moves every frame */
+	Spatialize_Dynamic,
+	/** Spatialized, moves while awake and is static while dormant */
+	Spatialize_Dormancy,
+};
+
+/**
+ * Replicates the connection's own player controller, view target and player state. Owner only
+ * data never goes through the spatial grid.
+ */
+UCLASS()
+class BMGAMEPLAYSERVER_API UBMReplicationGraphNode_OwnerOnly : public UReplicationGraphNode
+{
+	GENERATED_BODY()
+
+public:
+	virtual void NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo) override { }
+	virtual bool NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound = true) override { return false; }
+	virtual void NotifyResetAllNetworkActors() override { }
+
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+
+private:
+	FActorRepListRefView ReplicationActorList;
+};
+
+/**
+ * Replication graph of the module. Characters and projectiles live in a 2D spatial grid, game
+ * state and other always relevant actors in a single list shared by every connection, and owner
+ * only actors in a per connection node. Net tick cost no longer walks every actor per connection.
+ */
+UCLASS(transient, config=Engine)
+class BMGAMEPLAYSERVER_API UBMReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+	UBMReplicationGraph();
+
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+
+	/** Times the net tick for bm.RepGraph.Report, and reports on its own with -bmrepgraphreport=Seconds */
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+	/** Counts sent RPCs for bm.NetReport */
+	virtual bool ProcessRemoteFunction(class AActor* Actor, UFunction* Function, void* Parameters, FOutParmRec* OutParms, FFrame* Stack, UObject* SubObject) override;
+
+	/**
+	 * Logs average and worst net tick cost since the last report and resets them. With
+	 * -bmrepgraphreport the report is also appended to BMRepGraph.csv in the profiling directory.
+	 */
+	void LogNetTickReport();
+
+protected:
+	/** Edge of a spatial grid cell, in cm */
+	UPROPERTY(config)
+	float GridCellSize;
+
+	/** Lowest world X and Y the grid expects, actors below it are clamped into the first cells */
+	UPROPERTY(config)
+	FVector2D SpatialBias;
+
+	/** Characters further than this from a viewer are not replicated to it, in cm */
+	UPROPERTY(config)
+	float CharacterCullDistance;
+
+	/** Projectiles further than this from a viewer are not replicated to it, in cm */
+	UPROPERTY(config)
+	float ProjectileCullDistance;
+
+	/** Don't rebuild the grid when an actor moves outside of its bounds */
+	UPROPERTY(config)
+	bool bDisableSpatialRebuilds;
+
+private:
+	UPROPERTY()
+	UReplicationGraphNode_GridSpatialization2D* GridNode;
+
+	UPROPERTY()
+	UReplicationGraphNode_ActorList* AlwaysRelevantNode;
+
+	TClassMap<EBMClassRepNodeMapping> ClassRepNodePolicies;
+
+	/** Net tick timing since the last report */
+	double NetTickSeconds;
+	double NetTickMaxSeconds;
+	int32 NetTickCount;
+	int32 NetTickConnections;
+
+	/** Seconds between automatic reports from the command line, 0 reports on bm.RepGraph.Report only */
+	float AutoReportSeconds;
+	double LastReportTime;
+};
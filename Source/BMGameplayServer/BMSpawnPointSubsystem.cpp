@@ -0,0 +1,220 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BMSpawnPointSubsystem.h"
+
+#include "BMGameplayServer.h"
+#include "BMPawnSpatialGrid.h"
+#include "CollisionQueryParams.h"
+#include "Engine/World.h"
+#include "NavigationSystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Spawn point sampling"), STAT_BMSpawnPointSampling, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Spawn point lookup"), STAT_BMSpawnPointLookup, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Spawn points rejected"), STAT_BMSpawnPointsRejected, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Spawn point cache misses"), STAT_BMSpawnPointMisses, STATGROUP_BMGameplay);
+
+namespace BMSpawnPoint
+{
+	/** Floors steeper than this are not walkable */
+	static const float MinFloorNormalZ = 0.7f;
+
+	/** How far above and below the navmesh point the floor is searched, in cm */
+	static const float FloorSearchUp = 100.f;
+	static const float FloorSearchDown = 250.f;
+
+	/** Gap between floor and capsule, in cm */
+	static const float FloorClearance = 2.f;
+}
+
+UBMSpawnPointSubsystem::UBMSpawnPointSubsystem()
+{
+	PoolSize = 64;
+	RefreshInterval = 5.0f;
+	PointsPerRefresh = 4;
+	MaxSamplesPerTick = 32;
+	CapsuleRadius = 55.0f;
+	CapsuleHalfHeight = 96.0f;
+	ReuseCooldown = 3.0f;
+	LastRefreshTime = 0.0f;
+}
+
+bool UBMSpawnPointSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+bool UBMSpawnPointSubsystem::IsTickable() const
+{
+	const UWorld* World = GetWorld();
+	return World && World->GetNetMode() != NM_Client;
+}
+
+ETickableTickType UBMSpawnPointSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UBMSpawnPointSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBMSpawnPointSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UBMSpawnPointSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void UBMSpawnPointSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMSpawnPointSampling);
+
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	// Fill the pool as soon as the navmesh answers, a tick's budget at a time
+	if (SpawnPoints.Num() < PoolSize)
+	{
+		for (int32 Sample = 0; Sample < MaxSamplesPerTick && SpawnPoints.Num() < PoolSize; ++Sample)
+		{
+			FBMSpawnPoint Point;
+			if (SampleSpawnPoint(Point))
+			{
+				SpawnPoints.Add(Point);
+			}
+		}
+		LastRefreshTime = Now;
+		return;
+	}
+
+	if (Now - LastRefreshTime < RefreshInterval)
+	{
+		return;
+	}
+	LastRefreshTime = Now;
+
+	// Level geometry can change, replace the oldest points
+	SpawnPoints.Sort([](const FBMSpawnPoint& A, const FBMSpawnPoint& B) { return A.ValidatedTime < B.ValidatedTime; });
+	for (int32 i = 0; i < FMath::Min(PointsPerRefresh, SpawnPoints.Num()); ++i)
+	{
+		FBMSpawnPoint Point;
+		if (SampleSpawnPoint(Point))
+		{
+			Point.LastUsedTime = SpawnPoints[i].LastUsedTime;
+			SpawnPoints[i] = Point;
+		}
+	}
+}
+
+bool UBMSpawnPointSubsystem::SampleSpawnPoint(FBMSpawnPoint& OutPoint) const
+{
+	UWorld* World = GetWorld();
+	UNavigationSystemV1* NavSys = UNavigationSystemV1::GetCurrent<UNavigationSystemV1>(World);
+	FNavLocation NavLocation;
+	if (NavSys == nullptr || !NavSys->GetRandomPoint(NavLocation))
+	{
+		return false;
+	}
+
+	// A walkable floor right under the navmesh point
+	FHitResult FloorHit;
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(BMSpawnPointFloor), false);
+	const FVector Start = NavLocation.Location + FVector(0.f, 0.f, BMSpawnPoint::FloorSearchUp);
+	const FVector End = NavLocation.Location - FVector(0.f, 0.f, BMSpawnPoint::FloorSearchDown);
+	if (!World->LineTraceSingleByChannel(FloorHit, Start, End, ECC_Visibility, QueryParams)
+		|| FloorHit.ImpactNormal.Z < BMSpawnPoint::MinFloorNormalZ)
+	{
+		INC_DWORD_STAT(STAT_BMSpawnPointsRejected);
+		return false;
+	}
+
+	// Room for a capsule standing there, ignoring characters which move anyway
+	const FVector CapsuleCenter = FloorHit.ImpactPoint + FVector(0.f, 0.f, CapsuleHalfHeight + BMSpawnPoint::FloorClearance);
+	FCollisionObjectQueryParams StaticObjects;
+	StaticObjects.AddObjectTypesToQuery(ECC_WorldStatic);
+	StaticObjects.AddObjectTypesToQuery(ECC_WorldDynamic);
+	if (World->OverlapAnyTestByObjectType(CapsuleCenter, FQuat::Identity, StaticObjects,
+		FCollisionShape::MakeCapsule(CapsuleRadius, CapsuleHalfHeight), FCollisionQueryParams(SCENE_QUERY_STAT(BMSpawnPointClearance), false)))
+	{
+		INC_DWORD_STAT(STAT_BMSpawnPointsRejected);
+		return false;
+	}
+
+	OutPoint.Location = CapsuleCenter;
+	OutPoint.ValidatedTime = World->GetTimeSeconds();
+	OutPoint.LastUsedTime = -MAX_flt;
+	return true;
+}
+
+bool UBMSpawnPointSubsystem::FindSpawnLocation(const AActor* Respawning, FVector& OutLocation)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BMSpawnPointLookup);
+
+	UWorld* World = GetWorld();
+	if (SpawnPoints.Num() == 0)
+	{
+		// Pool not filled yet, pay for the navmesh query this once
+		INC_DWORD_STAT(STAT_BMSpawnPointMisses);
+		UNavigationSystemV1* NavSys = UNavigationSystemV1::GetCurrent<UNavigationSystemV1>(World);
+		FNavLocation NavLocation;
+		if (NavSys && NavSys->GetRandomPoint(NavLocation))
+		{
+			OutLocation = NavLocation.Location + FVector(0.f, 0.f, CapsuleHalfHeight);
+			return true;
+		}
+		return false;
+	}
+
+	TArray<FVector> EnemyLocations;
+	UBMPawnSpatialGrid* SpatialGrid = World->GetSubsystem<UBMPawnSpatialGrid>();
+	if (SpatialGrid)
+	{
+		SpatialGrid->GetCharacterLocations(Respawning, EnemyLocations);
+	}
+
+	// Rested points beat recently used ones, then the furthest from the closest enemy wins, then the
+	// one used longest ago. Compared tier by tier, a penalty folded into the distance is lost to
+	// float precision at world scale and the same point would win every time with nobody alive
+	const float Now = World->GetTimeSeconds();
+	int32 BestIndex = INDEX_NONE;
+	bool bBestRested = false;
+	float BestEnemyDist = 0.f;
+	for (int32 i = 0; i < SpawnPoints.Num(); ++i)
+	{
+		const FBMSpawnPoint& Point = SpawnPoints[i];
+
+		float ClosestEnemyDistSquared = FMath::Square(WORLD_MAX);
+		for (const FVector& EnemyLocation : EnemyLocations)
+		{
+			ClosestEnemyDistSquared = FMath::Min(ClosestEnemyDistSquared, FVector::DistSquared(Point.Location, EnemyLocation));
+		}
+
+		const bool bRested = Now - Point.LastUsedTime >= ReuseCooldown;
+		const float EnemyDist = FMath::Sqrt(ClosestEnemyDistSquared);
+
+		bool bBetter = BestIndex == INDEX_NONE;
+		if (!bBetter && bRested != bBestRested)
+		{
+			bBetter = bRested;
+		}
+		else if (!bBetter && EnemyDist != BestEnemyDist)
+		{
+			bBetter = EnemyDist > BestEnemyDist;
+		}
+		else if (!bBetter)
+		{
+			bBetter = Point.LastUsedTime < SpawnPoints[BestIndex].LastUsedTime;
+		}
+
+		if (bBetter)
+		{
+			BestIndex = i;
+			bBestRested = bRested;
+			BestEnemyDist = EnemyDist;
+		}
+	}
+
+	SpawnPoints[BestIndex].LastUsedTime = Now;
+	OutLocation = SpawnPoints[BestIndex].Location;
+	return true;
+}
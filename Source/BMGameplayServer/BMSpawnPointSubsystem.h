@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BMSpawnPointSubsystem.generated.h"
+
+/** Navmesh point already checked for floor and capsule clearance */
+struct FBMSpawnPoint
+{
+	/** Capsule center standing on the floor */
+	FVector Location;
+
+	/** World time it was validated, the oldest points are resampled first */
+	float ValidatedTime;
+
+	/** World time someone last spawned here */
+	float LastUsedTime;
+};
+
+/**
+ * Keeps a pool of pre-validated respawn points. Points are sampled from the navmesh and checked
+ * for a walkable floor and a free capsule when the map starts and a few at a time afterwards, so
+ * picking a respawn point is a scan of the pool scored against live character positions, with no
+ * navmesh or physics query on the hot path. Server only.
+ */
+UCLASS(config=Game)
+class BMGAMEPLAYSERVER_API UBMSpawnPointSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	UBMSpawnPointSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	// End of FTickableGameObject interface
+
+	/**
+	 * Best cached point for the respawning actor: furthest from every other character and not
+	 * used recently. Falls back to a direct navmesh query while the pool is still empty.
+	 */
+	bool FindSpawnLocation(const AActor* Respawning, FVector& OutLocation);
+
+	FORCEINLINE int32 GetNumSpawnPoints() const { return SpawnPoints.Num(); }
+
+protected:
+	/** Validated points kept in the pool */
+	UPROPERTY(config)
+	int32 PoolSize;
+
+	/** Seconds between background refreshes */
+	UPROPERTY(config)
+	float RefreshInterval;
+
+	/** Oldest points resampled per refresh */
+	UPROPERTY(config)
+	int32 PointsPerRefresh;
+
+	/** Navmesh samples tried per tick while filling the pool */
+	UPROPERTY(config)
+	int32 MaxSamplesPerTick;
+
+	/** Capsule checked for clearance, matches the character's */
+	UPROPERTY(config)
+	float CapsuleRadius;
+
+	UPROPERTY(config)
+	float CapsuleHalfHeight;
+
+	/** A point used less than this long ago is only picked when nothing else is left, in seconds */
+	UPROPERTY(config)
+	float ReuseCooldown;
+
+private:
+	/** Samples a navmesh point and validates it, false when it fails a check */
+	bool SampleSpawnPoint(FBMSpawnPoint& OutPoint) const;
+
+	TArray<FBMSpawnPoint> SpawnPoints;
+
+	float LastRefreshTime;
+};
@@ -7,7 +7,18 @@
 #include "BMGameplayServerCharacter.h"
 #include "DrawDebugHelpers.h"			// DrawDebugSphere
 #include "Engine/Engine.h"				// GEngine
-#include "Kismet/KismetSystemLibrary.h"	// Sphere overlap
+#include "GameFramework/GameStateBase.h"	// Server world time
+#include "BMAreaDamageSubsystem.h"
+#include "BMPawnSpatialGrid.h"
+#include "BMGameplayServer.h"
+#include "TimerManager.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Ticking sphere components"), STAT_BMTickingSphereComponents, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Sphere tick"), STAT_BMSphereTick, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Sphere overlap query"), STAT_BMSphereOverlapQuery, STATGROUP_BMGameplay);
+DECLARE_CYCLE_STAT(TEXT("Sphere fire"), STAT_BMSphereFire, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sphere overlap queries"), STAT_BMSphereOverlapQueries, STATGROUP_BMGameplay);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sphere spells fired"), STAT_BMSphereSpellsFired, STATGROUP_BMGameplay);
 
 // Sets default values for this component's properties
 UBMSphereAttackComponent::UBMSphereAttackComponent()
@@ -15,6 +26,8 @@ UBMSphereAttackComponent::UBMSphereAttackComponent()
 	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
 	// off to improve performance if you don't need them.
 	PrimaryComponentTick.bCanEverTick = true;
+	// Only ticks while charging, cooling down or tracking overlaps, see RefreshTickState
+	PrimaryComponentTick.bStartWithTickEnabled = false;
 
 	// initial config values
 	InitialRadius = 100.0f;
@@ -22,6 +35,13 @@ UBMSphereAttackComponent::UBMSphereAttackComponent()
 	SpeedRadius = 400.0f;
 	Cooldown = 5.0f;
 	DamageAmount = 50.0f;
+	DamageFalloffExponent = 0.0f;
+	MinDamageScale = 0.25f;
+	bRequireLineOfSight = true;
+	OverlapQueryInterval = 0.1f;
+	OverlapExitHysteresis = 25.0f;
+	LastOverlapQueryTime = 0.0f;
+	bCountedActive = false;
 	
 	CurrentRadius = 0.0f;
 	CurrentCooldown = 0.0f;
@@ -37,6 +57,80 @@ void UBMSphereAttackComponent::BeginPlay()
 
 	// ...
 	CharacterOwner = (ABMGameplayServerCharacter*)GetOwner();
+
+	RefreshTickState();
+}
+
+void UBMSphereAttackComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (IsComponentTickEnabled())
+	{
+		DEC_DWORD_STAT(STAT_BMTickingSphereComponents);
+	}
+
+	BMEntityCounts::Track(BMEntityCounts::ActiveSpheres, bCountedActive, false);
+
+	GetWorld()->GetTimerManager().ClearTimer(CooldownTimerHandle);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UBMSphereAttackComponent::RefreshTickState()
+{
+	// Every change of Activated ends up here
+	BMEntityCounts::Track(BMEntityCounts::ActiveSpheres, bCountedActive, Activated);
+
+	if (CharacterOwner == nullptr)
+	{
+		return;
+	}
+
+	// The server derives radius and cooldown when needed, only clients draw and the local player updates its hud
+	const bool bLocallyControlled = CharacterOwner->IsLocallyControlled();
+	const bool bRemote = CharacterOwner->GetLocalRole() < ROLE_Authority;
+	const bool bNeedsTick = (Activated && (bLocallyControlled || bRemote))
+		|| (bLocallyControlled && IsInCooldown())
+		|| NumEnemies != 0;
+
+	if (bNeedsTick != IsComponentTickEnabled())
+	{
+		SetComponentTickEnabled(bNeedsTick);
+
+		if (bNeedsTick)
+		{
+			INC_DWORD_STAT(STAT_BMTickingSphereComponents);
+		}
+		else
+		{
+			DEC_DWORD_STAT(STAT_BMTickingSphereComponents);
+		}
+	}
+}
+
+void UBMSphereAttackComponent::StartCooldownTimer()
+{
+	const float remaining = CooldownEndTime.GetSeconds() - GetServerWorldTime();
+	if (remaining > 0.0f)
+	{
+		GetWorld()->GetTimerManager().SetTimer(CooldownTimerHandle, this, &UBMSphereAttackComponent::OnCooldownExpired, remaining, false);
+	}
+	else
+	{
+		OnCooldownExpired();
+	}
+}
+
+void UBMSphereAttackComponent::OnCooldownExpired()
+{
+	UpdateSphereState();
+
+	// update locally controlled hud
+	if (CharacterOwner && CharacterOwner->IsLocallyControlled())
+	{
+		CharacterOwner->OnCooldownEvent();
+	}
+
+	RefreshTickState();
 }
 
 
@@ -45,19 +139,25 @@ void UBMSphereAttackComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	// Modify radius and cooldown only on server side
-	if (CharacterOwner->GetLocalRole() == ROLE_Authority)
+	SCOPE_CYCLE_COUNTER(STAT_BMSphereTick);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, SphereTick);
+
+	// Radius and cooldown are derived from replicated times on every machine
+	const float previousRadius = CurrentRadius;
+	const float previousCooldown = CurrentCooldown;
+	UpdateSphereState();
+
+	// update locally controlled hud
+	if (CharacterOwner->IsLocallyControlled())
 	{
-		if (Activated)
+		if (CurrentRadius != previousRadius)
 		{
-			CurrentRadius += SpeedRadius * DeltaTime;
-			CurrentRadius = FMath::Clamp(CurrentRadius, InitialRadius, MaxRadius);
+			CharacterOwner->OnSphereEvent();
 		}
 
-		if (IsInCooldown())
+		if (CurrentCooldown != previousCooldown)
 		{
-			CurrentCooldown -= DeltaTime;
-			CurrentCooldown = FMath::Clamp(CurrentCooldown, 0.0f, Cooldown);
+			CharacterOwner->OnCooldownEvent();
 		}
 	}
 
@@ -84,36 +184,84 @@ void UBMSphereAttackComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 		// TO-DO more elegant
 		if (!Activated && NumEnemies != 0)
 		{
+			TrackedEnemies.Reset();
 			NumEnemies = 0;
 			CharacterOwner->OnEnemyOverlapEvent();
 		}
 	}
 
+	// Go to sleep once there is nothing left to update
+	RefreshTickState();
+}
+
+float UBMSphereAttackComponent::GetServerWorldTime() const
+{
+	const AGameStateBase* gameState = GetWorld()->GetGameState();
+	return gameState ? gameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+}
+
+void UBMSphereAttackComponent::UpdateSphereState()
+{
+	const float serverTime = GetServerWorldTime();
+
+	if (Activated)
+	{
+		CurrentRadius = InitialRadius + SpeedRadius * (serverTime - ActivationStartTime.GetSeconds());
+		CurrentRadius = FMath::Clamp(CurrentRadius, InitialRadius, MaxRadius);
+	}
+
+	CurrentCooldown = FMath::Clamp(CooldownEndTime.GetSeconds() - serverTime, 0.0f, Cooldown);
 }
 
-void UBMSphereAttackComponent::OnRep_CurrentRadius()
+void UBMSphereAttackComponent::OnRep_ActivationStartTime()
 {
+	UpdateSphereState();
+
 	// update locally controlled hud
-	if (CharacterOwner->IsLocallyControlled())
+	if (CharacterOwner && CharacterOwner->IsLocallyControlled())
 	{
 		CharacterOwner->OnSphereEvent();
 	}
 }
 
-void UBMSphereAttackComponent::OnRep_CurrentCooldown()
+void UBMSphereAttackComponent::OnRep_CooldownEndTime()
 {
+	// Released: back to the initial radius
+	CurrentRadius = InitialRadius;
+	UpdateSphereState();
+
 	// update locally controlled hud
-	if (CharacterOwner->IsLocallyControlled())
+	if (CharacterOwner && CharacterOwner->IsLocallyControlled())
 	{
+		CharacterOwner->OnSphereEvent();
 		CharacterOwner->OnCooldownEvent();
 	}
+
+	StartCooldownTimer();
+	RefreshTickState();
+}
+
+void UBMSphereAttackComponent::OnRep_Activated()
+{
+	// Count enemies on the first charging frame instead of waiting a query interval
+	LastOverlapQueryTime = -OverlapQueryInterval;
+
+	UpdateSphereState();
+	RefreshTickState();
 }
 
 void UBMSphereAttackComponent::ActivateSphere()
 {
+	UpdateSphereState();
+
 	if (!IsInCooldown())
 	{
+		// Rounded like the clients receive it, so both grow the same sphere
+		ActivationStartTime.SetSeconds(GetServerWorldTime());
 		Activated = true;
+		BM_MARK_PROPERTY_DIRTY(UBMSphereAttackComponent, ActivationStartTime, this);
+		BM_MARK_PROPERTY_DIRTY(UBMSphereAttackComponent, Activated, this);
+		UpdateSphereState();
 	}
 }
 
@@ -121,52 +269,82 @@ void UBMSphereAttackComponent::DeactivateSphere()
 {
 	if (Activated)
 	{
+		// Fire with the radius reached right now
+		UpdateSphereState();
 		FireSpell();
 
 		// Restore current radius
 		CurrentRadius = InitialRadius;
 		// Restore cooldown to max
+		CooldownEndTime.SetSeconds(GetServerWorldTime() + Cooldown);
 		CurrentCooldown = Cooldown;
 		// Deactivate sphere
 		Activated = false;
+		BM_MARK_PROPERTY_DIRTY(UBMSphereAttackComponent, CooldownEndTime, this);
+		BM_MARK_PROPERTY_DIRTY(UBMSphereAttackComponent, Activated, this);
+
+		StartCooldownTimer();
+		RefreshTickState();
 	}
 }
 
 int UBMSphereAttackComponent::CheckOverlapEnemies()
 {
-	TArray<AActor*> outActors;
-	TArray<AActor*> actorsToIgnore;
-	actorsToIgnore.Add(CharacterOwner);
-	TArray<TEnumAsByte<EObjectTypeQuery>> traceObjectTypes;
-	traceObjectTypes.Add(UEngineTypes::ConvertToObjectType(ECollisionChannel::ECC_Pawn));
+	const float worldTime = GetWorld()->GetTimeSeconds();
+	if (worldTime - LastOverlapQueryTime < OverlapQueryInterval)
+	{
+		return TrackedEnemies.Num();
+	}
+	LastOverlapQueryTime = worldTime;
 
-	if (UKismetSystemLibrary::SphereOverlapActors(GetWorld(),
-		CharacterOwner->GetActorLocation(), CurrentRadius, traceObjectTypes, NULL, actorsToIgnore, outActors))
+	SCOPE_CYCLE_COUNTER(STAT_BMSphereOverlapQuery);
+	CSV_SCOPED_TIMING_STAT(BMGameplay, SphereOverlapQuery);
+	INC_DWORD_STAT(STAT_BMSphereOverlapQueries);
+
+	UBMPawnSpatialGrid* spatialGrid = GetWorld()->GetSubsystem<UBMPawnSpatialGrid>();
+	if (spatialGrid == nullptr)
+	{
+		TrackedEnemies.Reset();
+		return 0;
+	}
+
+	// Enter at the radius, leave past radius plus hysteresis so edge enemies don't flicker the hud
+	Swap(TrackedEnemies, PreviousTrackedEnemies);
+	TrackedEnemies.Reset();
+	OverlapHits.Reset();
+	spatialGrid->GetCharacterHitsInSphere(CharacterOwner->GetActorLocation(), CurrentRadius + OverlapExitHysteresis, CharacterOwner, OverlapHits);
+
+	for (const FBMSpatialGridHit& hit : OverlapHits)
 	{
-		return outActors.Num();
+		if (hit.Distance <= CurrentRadius || PreviousTrackedEnemies.Contains(hit.Character))
+		{
+			TrackedEnemies.Add(hit.Character);
+		}
 	}
 
-	return 0;
+	return TrackedEnemies.Num();
 }
 
 void UBMSphereAttackComponent::FireSpell()
 {
 	if (CharacterOwner->GetLocalRole() == ROLE_Authority)
 	{
-		TArray<AActor*> outActors;
-		TArray<AActor*> actorsToIgnore;
-		actorsToIgnore.Add(CharacterOwner);
-		TArray<TEnumAsByte<EObjectTypeQuery>> traceObjectTypes;
-		traceObjectTypes.Add(UEngineTypes::ConvertToObjectType(ECollisionChannel::ECC_Pawn));
+		SCOPE_CYCLE_COUNTER(STAT_BMSphereFire);
+		CSV_SCOPED_TIMING_STAT(BMGameplay, SphereFire);
+		CSV_CUSTOM_STAT(BMGameplay, SphereSpellsFired, 1, ECsvCustomStatOp::Accumulate);
+		INC_DWORD_STAT(STAT_BMSphereSpellsFired);
 
-		if (UKismetSystemLibrary::SphereOverlapActors(GetWorld(),
-			CharacterOwner->GetActorLocation(), CurrentRadius, traceObjectTypes, NULL, actorsToIgnore, outActors))
+		UBMAreaDamageSubsystem* areaDamage = GetWorld()->GetSubsystem<UBMAreaDamageSubsystem>();
+		if (areaDamage)
 		{
-			for (AActor* actor : outActors)
-			{
-				FDamageEvent DamageEvent;
-				actor->TakeDamage(DamageAmount, DamageEvent, CharacterOwner->GetController(), CharacterOwner);
-			}
+			FBMAreaDamageParams params;
+			params.Center = CharacterOwner->GetActorLocation();
+			params.Radius = CurrentRadius;
+			params.Damage = DamageAmount;
+			params.FalloffExponent = DamageFalloffExponent;
+			params.MinDamageScale = MinDamageScale;
+			params.bRequireLineOfSight = bRequireLineOfSight;
+			areaDamage->ApplySphereDamage(CharacterOwner, params);
 		}
 	}
 }
@@ -176,17 +354,47 @@ void UBMSphereAttackComponent::GetLifetimeReplicatedProps(TArray <FLifetimePrope
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME(UBMSphereAttackComponent, CurrentRadius);
-	DOREPLIFETIME(UBMSphereAttackComponent, CurrentCooldown);
-	DOREPLIFETIME(UBMSphereAttackComponent, Activated);
+	// Everyone draws the sphere, only the owner's HUD shows the cooldown
+	BM_DOREPLIFETIME_PUSH(UBMSphereAttackComponent, ActivationStartTime, COND_None);
+	BM_DOREPLIFETIME_PUSH(UBMSphereAttackComponent, CooldownEndTime, COND_OwnerOnly);
+	BM_DOREPLIFETIME_PUSH(UBMSphereAttackComponent, Activated, COND_None);
 }
 
 void UBMSphereAttackComponent::ServerActivateSphere_Implementation()
 {
 	ActivateSphere();
+	RefreshTickState();
 }
 
 void UBMSphereAttackComponent::ServerDeactivateSphere_Implementation()
 {
 	DeactivateSphere();
+}
+
+void UBMSphereAttackComponent::ResetAbility()
+{
+	GetWorld()->GetTimerManager().ClearTimer(CooldownTimerHandle);
+
+	// Clients pick the new state up through OnRep_Activated and OnRep_CooldownEndTime
+	Activated = false;
+	ActivationStartTime = FBMNetTime();
+	CooldownEndTime = FBMNetTime();
+	BM_MARK_PROPERTY_DIRTY(UBMSphereAttackComponent, Activated, this);
+	BM_MARK_PROPERTY_DIRTY(UBMSphereAttackComponent, ActivationStartTime, this);
+	BM_MARK_PROPERTY_DIRTY(UBMSphereAttackComponent, CooldownEndTime, this);
+
+	CurrentRadius = InitialRadius;
+	CurrentCooldown = 0.0f;
+
+	TrackedEnemies.Reset();
+	NumEnemies = 0;
+
+	// update locally controlled hud
+	if (CharacterOwner && CharacterOwner->IsLocallyControlled())
+	{
+		CharacterOwner->OnSphereEvent();
+		CharacterOwner->OnCooldownEvent();
+	}
+
+	RefreshTickState();
 }
\ No newline at end of file
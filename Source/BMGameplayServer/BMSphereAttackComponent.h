@@ -4,6 +4,9 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "Engine/EngineTypes.h"
+#include "BMNetQuantization.h"
+#include "BMPawnSpatialGrid.h"
 #include "BMSphereAttackComponent.generated.h"
 
 
@@ -27,14 +30,40 @@ protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Enables the tick only while charging, cooling down (local player) or tracking overlaps */
+	void RefreshTickState();
+
+	/** Wakes the component when the cooldown ends */
+	void StartCooldownTimer();
+
+	void OnCooldownExpired();
+
+	FTimerHandle CooldownTimerHandle;
+
 	void ActivateSphere();
 
 	void DeactivateSphere();
 
 	void FireSpell();
 
+	/** Updates TrackedEnemies from the spatial grid, at most every OverlapQueryInterval */
 	int CheckOverlapEnemies();
 
+	/** Enemies inside the sphere since the last overlap query */
+	TSet<TWeakObjectPtr<class ABMGameplayServerCharacter>> TrackedEnemies;
+
+	/** Tracked enemies of the query before, and the query's hits, kept to reuse their memory */
+	TSet<TWeakObjectPtr<class ABMGameplayServerCharacter>> PreviousTrackedEnemies;
+	TArray<FBMSpatialGridHit> OverlapHits;
+
+	/** World time of the last overlap query */
+	float LastOverlapQueryTime;
+
+	/** Counted in BMEntityCounts::ActiveSpheres */
+	bool bCountedActive;
+
 	/** The sphere's maximum radius */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gameplay")
 	float InitialRadius;
@@ -55,29 +84,67 @@ protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Gameplay")
 	int NumEnemies;
 
+	/** Seconds between enemy overlap queries while charging, 0 queries every frame */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gameplay")
+	float OverlapQueryInterval;
+
+	/** Tracked enemies only leave once they are this much further than the radius */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gameplay")
+	float OverlapExitHysteresis;
+
 	/** The spell's damage */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gameplay")
 	float DamageAmount;
 
-	/** The sphere's current radius */
-	UPROPERTY(ReplicatedUsing = OnRep_CurrentRadius)
+	/** Damage scales with (1 - distance / radius) ^ exponent, 0 deals full damage everywhere */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gameplay", meta = (ClampMin = "0.0"))
+	float DamageFalloffExponent;
+
+	/** Falloff never scales damage below this */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gameplay", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float MinDamageScale;
+
+	/** Walls between the caster and an enemy block the spell */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gameplay")
+	bool bRequireLineOfSight;
+
+	/** The sphere's current radius, derived from ActivationStartTime */
+	UPROPERTY(Transient)
 	float CurrentRadius;
 
-	/** The sphere's current cooldown */
-	UPROPERTY(ReplicatedUsing = OnRep_CurrentCooldown)
+	/** The sphere's current cooldown, derived from CooldownEndTime */
+	UPROPERTY(Transient)
 	float CurrentCooldown;
 
+	/** Server world time the sphere started growing */
+	UPROPERTY(ReplicatedUsing = OnRep_ActivationStartTime)
+	FBMNetTime ActivationStartTime;
+
+	/** Server world time the cooldown ends */
+	UPROPERTY(ReplicatedUsing = OnRep_CooldownEndTime)
+	FBMNetTime CooldownEndTime;
+
 	/** Spell tick activation */
-	UPROPERTY(Replicated)
+	UPROPERTY(ReplicatedUsing = OnRep_Activated)
 	bool Activated;
 
-	/** RepNotify for changes made to current radius */
+	/** RepNotify for activation, wakes or puts the component to sleep */
+	UFUNCTION()
+	void OnRep_Activated();
+
+	/** RepNotify for a new activation */
 	UFUNCTION()
-	void OnRep_CurrentRadius();
+	void OnRep_ActivationStartTime();
 
-	/** RepNotify for changes made to current cooldown */
+	/** RepNotify for a new cooldown */
 	UFUNCTION()
-	void OnRep_CurrentCooldown();
+	void OnRep_CooldownEndTime();
+
+	/** Recomputes current radius and cooldown from the replicated times */
+	void UpdateSphereState();
+
+	/** World time synchronized with the server */
+	float GetServerWorldTime() const;
 
 public:
 	// Called every frame
@@ -89,6 +156,9 @@ public:
 	UFUNCTION(Server, reliable)
 	void ServerDeactivateSphere();
 
+	/** Drops any charge and cooldown without firing, on respawn. Server only */
+	void ResetAbility();
+
 	/** Is cooldown active */
 	UFUNCTION(BlueprintPure, Category = "Gameplay")
 	FORCEINLINE bool IsInCooldown() const { return CurrentCooldown > 0; }
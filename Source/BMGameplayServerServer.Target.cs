@@ -0,0 +1,18 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+public class BMGameplayServerServerTarget : TargetRules
+{
+	public BMGameplayServerServerTarget(TargetInfo Target) : base(Target)
+	{
+		Type = TargetType.Server;
+		DefaultBuildSettings = BuildSettingsVersion.V2;
+		ExtraModuleNames.Add("BMGameplayServer");
+#if UE_4_25_OR_LATER
+		// Gameplay properties replicate through the push model, see BM_WITH_PUSH_MODEL
+		bWithPushModel = true;
+#endif
+	}
+}